@@ -0,0 +1,788 @@
+#include "pathfinding.h"
+#include "contraction.h"
+#include "cooperative_search.h"
+#include "distance_map.h"
+#include "landmarks.h"
+#include "path_database.h"
+#include "subgoal_graph.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// Usage: benchmark, prints one JSON document with ns/op and allocations/op per primitive.
+// Maps and queries come from a fixed seed so runs on the same machine are comparable
+const unsigned int GLOBAL_CONST_BENCHMARK_SEED = 42;
+const int GLOBAL_CONST_BENCHMARK_COLUMNS = 256;
+const int GLOBAL_CONST_BENCHMARK_ROWS = 256;
+// Share of the benchmark map covered by walls, in percent
+const int GLOBAL_CONST_BENCHMARK_WALLS = 20;
+// Every benchmark keeps the best of this many runs, the first one also warms the caches
+const int GLOBAL_CONST_BENCHMARK_REPETITIONS = 5;
+// Nodes the open and closed sets hold while their operations are timed
+const int GLOBAL_CONST_BENCHMARK_SET_SIZE = 200;
+// Steps of the paths the retrace benchmarks walk back
+const int GLOBAL_CONST_BENCHMARK_PATH_LENGTH = 64;
+
+// Every heap allocation in the process is counted, benchmarks report the ones made while they run
+static size_t gAllocationCount = 0;
+// Results are folded into this so the timed loops cannot be optimized away
+static volatile long long gSink = 0;
+
+void* operator new(size_t size)
+{
+	gAllocationCount++;
+	void* memory = std::malloc(size > 0 ? size : 1);
+	if (memory == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+struct BenchmarkResult
+{
+	std::string name;
+	std::string map;
+	double nsPerOp;
+	double allocsPerOp;
+};
+
+static std::vector<BenchmarkResult> gResults;
+
+// Times body(operations), which must run that many operations of the primitive
+template <typename Function>
+void RunBenchmark(const char* name, const char* map, int operations, Function body)
+{
+	double bestMs = std::numeric_limits<double>::max();
+	size_t allocations = 0;
+	for (int repetition = 0; repetition < GLOBAL_CONST_BENCHMARK_REPETITIONS; repetition++)
+	{
+		size_t allocationsBefore = gAllocationCount;
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		body(operations);
+		bestMs = std::min(bestMs, GetElapsedMs(begin));
+		allocations = gAllocationCount - allocationsBefore;
+	}
+
+	BenchmarkResult result;
+	result.name = name;
+	result.map = map;
+	result.nsPerOp = bestMs * 1e6 / operations;
+	result.allocsPerOp = static_cast<double>(allocations) / operations;
+	gResults.push_back(result);
+}
+
+// Walkable nodes drawn at random, the endpoints the queries and primitives of a section run on
+std::vector<int> MakeQueryCells(const std::vector<unsigned char>& walkable, std::mt19937& random)
+{
+	std::vector<int> openCells;
+	for (int id = 0; id < static_cast<int>(walkable.size()); id++)
+	{
+		if (walkable[id])
+		{
+			openCells.push_back(id);
+		}
+	}
+	std::uniform_int_distribution<int> anyOpenCell(0, static_cast<int>(openCells.size()) - 1);
+	std::vector<int> cells(4096);
+	for (int& cell:cells)
+	{
+		cell = openCells[anyOpenCell(random)];
+	}
+	return cells;
+}
+
+// Times whole queries between cells 2048 apart. An untimed query first binds the grid to the
+// search and sizes its arrays, so only the queries themselves are counted
+void RunQueryBenchmark(const char* name, const char* map, int operations, const GridView& grid, const SearchConfig& config, const std::vector<int>& cells)
+{
+	PathSearch search;
+	search.FindPath(grid, cells[0], cells[0], config);
+	RunBenchmark(name, map, operations, [&](int queries) {
+		long long found = 0;
+		for (int i = 0; i < queries; i++)
+		{
+			found += search.FindPath(grid, cells[i & 4095], cells[(i + 2048) & 4095], config);
+		}
+		gSink = gSink + found;
+	});
+}
+
+// The search as it stood before the rewrite: nodes copied by value with their costs and
+// a parent list, neighbors found by scanning every node's window position. Kept only as a reference
+struct LegacyNode
+{
+	int id;
+	float x;
+	float y;
+	int gCost;
+	int hCost;
+	std::vector<LegacyNode> parent;
+
+	int fCost() const { return gCost + hCost; }
+	bool operator==(const LegacyNode& node) const { return id == node.id; }
+	bool operator!=(const LegacyNode& node) const { return id != node.id; }
+};
+
+// The old window layout, 20x20 nodes of 35 pixels
+const int GLOBAL_CONST_LEGACY_SIZE = 20;
+const float GLOBAL_CONST_LEGACY_NODE_SIZE = 35.0f;
+const float GLOBAL_CONST_LEGACY_WINDOW_SIZE = 700.0f;
+
+std::vector<LegacyNode> MakeLegacyNodes()
+{
+	std::vector<LegacyNode> nodes;
+	for (int i = 0; i < GLOBAL_CONST_LEGACY_SIZE; i++)
+	{
+		for (int j = 0; j < GLOBAL_CONST_LEGACY_SIZE; j++)
+		{
+			LegacyNode node;
+			node.id = i * GLOBAL_CONST_LEGACY_SIZE + j;
+			node.x = static_cast<int>(i * GLOBAL_CONST_LEGACY_NODE_SIZE + GLOBAL_CONST_LEGACY_NODE_SIZE / 2);
+			node.y = static_cast<int>(j * GLOBAL_CONST_LEGACY_NODE_SIZE + GLOBAL_CONST_LEGACY_NODE_SIZE / 2);
+			node.gCost = 0;
+			node.hCost = 0;
+			nodes.push_back(node);
+		}
+	}
+	return nodes;
+}
+
+std::vector<LegacyNode> LegacyGetNeighbors(const std::vector<LegacyNode>& nodes, LegacyNode currentNode)
+{
+	const float reach = GLOBAL_CONST_LEGACY_NODE_SIZE + GLOBAL_CONST_LEGACY_WINDOW_SIZE * 0.015f;
+	std::vector<LegacyNode> neighbors;
+	for (auto node:nodes)
+	{
+		if (node.x == currentNode.x && node.y == currentNode.y)
+		{
+			continue;
+		}
+		if (node.x > 0 && node.x < GLOBAL_CONST_LEGACY_WINDOW_SIZE && node.x > currentNode.x - reach && node.x < currentNode.x + reach &&
+			node.y >= 0 && node.y < GLOBAL_CONST_LEGACY_WINDOW_SIZE && node.y > currentNode.y - reach && node.y < currentNode.y + reach)
+		{
+			neighbors.push_back(node);
+		}
+	}
+	return neighbors;
+}
+
+int LegacyGetDistance(LegacyNode nodeA, LegacyNode nodeB)
+{
+	int distanceX = std::abs(static_cast<int>(nodeA.x - nodeB.x));
+	int distanceY = std::abs(static_cast<int>(nodeA.y - nodeB.y));
+	if (distanceX > distanceY)
+	{
+		return 14 * distanceY + 10 * (distanceX - distanceY);
+	}
+	return 14 * distanceX + 10 * (distanceY - distanceX);
+}
+
+void RunLegacyBenchmarks(std::mt19937& random)
+{
+	const char* map = "20x20";
+	const std::vector<LegacyNode> nodes = MakeLegacyNodes();
+	std::uniform_int_distribution<int> anyNode(0, static_cast<int>(nodes.size()) - 1);
+
+	RunBenchmark("neighbors/legacy_get_neighbors", map, 2000, [&](int operations) {
+		long long count = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			count += LegacyGetNeighbors(nodes, nodes[i % nodes.size()]).size();
+		}
+		gSink = gSink + count;
+	});
+
+	std::vector<int> pairs(2048);
+	for (int& node:pairs)
+	{
+		node = anyNode(random);
+	}
+	RunBenchmark("heuristic/legacy_get_distance", map, 1000000, [&](int operations) {
+		long long sum = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			sum += LegacyGetDistance(nodes[pairs[i & 2047]], nodes[pairs[(i + 1) & 2047]]);
+		}
+		gSink = gSink + sum;
+	});
+
+	// One op pushes a node and takes the cheapest one out again, as the old loop did per expansion
+	std::vector<int> costs(4096);
+	for (int& cost:costs)
+	{
+		cost = std::uniform_int_distribution<int>(0, 10000)(random);
+	}
+	RunBenchmark("open_set/legacy_vector_push_pop", map, 20000, [&](int operations) {
+		std::vector<LegacyNode> openSet;
+		for (int i = 0; i < GLOBAL_CONST_BENCHMARK_SET_SIZE; i++)
+		{
+			LegacyNode node = nodes[i % nodes.size()];
+			node.gCost = costs[i & 4095];
+			openSet.push_back(node);
+		}
+		long long sum = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			LegacyNode node = nodes[i % nodes.size()];
+			node.gCost = costs[i & 4095];
+			openSet.push_back(node);
+
+			LegacyNode currentNode = openSet[0];
+			for (size_t j = 1; j < openSet.size(); j++)
+			{
+				if (openSet[j].fCost() < currentNode.fCost() || (openSet[j].fCost() == currentNode.fCost() && openSet[j].hCost < currentNode.hCost))
+				{
+					currentNode = openSet[j];
+				}
+			}
+			openSet.erase(std::find(openSet.begin(), openSet.end(), currentNode));
+			sum += currentNode.gCost;
+		}
+		gSink = gSink + sum;
+	});
+
+	RunBenchmark("closed_set/legacy_vector_find", map, 100000, [&](int operations) {
+		std::vector<LegacyNode> closedSet(nodes.begin(), nodes.begin() + GLOBAL_CONST_BENCHMARK_SET_SIZE);
+		long long found = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			found += std::find(closedSet.begin(), closedSet.end(), nodes[pairs[i & 2047]]) != closedSet.end();
+		}
+		gSink = gSink + found;
+	});
+
+	// Every node holds a copy of its parent, so the chain is built once outside the timing
+	LegacyNode target = nodes[0];
+	for (int i = 1; i < GLOBAL_CONST_BENCHMARK_PATH_LENGTH; i++)
+	{
+		LegacyNode next = nodes[i % nodes.size()];
+		next.id = i;
+		next.parent.push_back(target);
+		target = next;
+	}
+	LegacyNode start = nodes[0];
+	RunBenchmark("retrace/legacy_node_copies", map, 200, [&](int operations) {
+		long long length = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			std::vector<LegacyNode> path;
+			LegacyNode currentNode = target;
+			while (currentNode != start)
+			{
+				path.push_back(currentNode);
+				LegacyNode parent = currentNode.parent[0];
+				currentNode = parent;
+			}
+			std::reverse(path.begin(), path.end());
+			length += path.size();
+		}
+		gSink = gSink + length;
+	});
+}
+
+// The current primitives, reached through the PathSearch friend declaration
+class PathSearchBenchmark
+{
+public:
+	static void Run(std::mt19937& random);
+};
+
+void PathSearchBenchmark::Run(std::mt19937& random)
+{
+	const char* map = "256x256";
+	const int columns = GLOBAL_CONST_BENCHMARK_COLUMNS;
+	const int rows = GLOBAL_CONST_BENCHMARK_ROWS;
+	std::vector<unsigned char> walkable(columns * rows);
+	std::uniform_int_distribution<int> percent(0, 99);
+	for (unsigned char& cell:walkable)
+	{
+		cell = percent(random) >= GLOBAL_CONST_BENCHMARK_WALLS;
+	}
+	std::vector<unsigned char> walkableBits;
+	PackWalkableBits(walkable, walkableBits);
+	std::vector<unsigned char> terrainCost(columns * rows, TERRAIN_GROUND);
+	GridView grid = { columns, rows, &walkableBits[0], &terrainCost[0], TERRAIN_GROUND, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+	std::vector<int> cells = MakeQueryCells(walkable, random);
+
+	// A trivial query binds the grid to the search and sizes its arrays
+	PathSearch search;
+	SearchConfig config = MakeDefaultSearchConfig();
+	search.FindPath(grid, cells[0], cells[0], config);
+
+	RunBenchmark("neighbors/can_step_8", map, 1000000, [&](int operations) {
+		static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+		static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+		long long count = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			const int x = cells[i & 4095] / rows;
+			const int y = cells[i & 4095] % rows;
+			for (int j = 0; j < 8; j++)
+			{
+				count += search.CanStep<false>(x, y, x + offsetX[j], y + offsetY[j]);
+			}
+		}
+		gSink = gSink + count;
+	});
+
+	std::vector<int> offsets(4096);
+	std::uniform_int_distribution<int> offset(0, 255);
+	for (int& value:offsets)
+	{
+		value = offset(random);
+	}
+	RunBenchmark("heuristic/octile_int", map, 10000000, [&](int operations) {
+		long long sum = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			sum += OctileHeuristic::Estimate<int>(offsets[i & 4095], offsets[(i + 7) & 4095]);
+		}
+		gSink = gSink + sum;
+	});
+	RunBenchmark("heuristic/octile_float", map, 10000000, [&](int operations) {
+		float sum = 0.0f;
+		for (int i = 0; i < operations; i++)
+		{
+			sum += OctileHeuristic::Estimate<float>(offsets[i & 4095], offsets[(i + 7) & 4095]);
+		}
+		gSink = gSink + static_cast<long long>(sum);
+	});
+	RunBenchmark("heuristic/euclidean_float", map, 10000000, [&](int operations) {
+		float sum = 0.0f;
+		for (int i = 0; i < operations; i++)
+		{
+			sum += EuclideanHeuristic::Estimate<float>(offsets[i & 4095], offsets[(i + 7) & 4095]);
+		}
+		gSink = gSink + static_cast<long long>(sum);
+	});
+
+	RunBenchmark("open_set/binary_heap_push_pop", map, 1000000, [&](int operations) {
+		SearchSpace<int>& space = search.mIntSearch;
+		OpenEntryGreater<int> greater;
+		space.Reset();
+		for (int i = 0; i < GLOBAL_CONST_BENCHMARK_SET_SIZE; i++)
+		{
+			OpenEntry<int> entry = { offsets[i & 4095] * 40, offsets[(i + 7) & 4095], i };
+			space.openSet.push_back(entry);
+			std::push_heap(space.openSet.begin(), space.openSet.end(), greater);
+		}
+		long long sum = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			OpenEntry<int> entry = { offsets[i & 4095] * 40, offsets[(i + 7) & 4095], i };
+			space.openSet.push_back(entry);
+			std::push_heap(space.openSet.begin(), space.openSet.end(), greater);
+			std::pop_heap(space.openSet.begin(), space.openSet.end(), greater);
+			sum += space.openSet.back().id;
+			space.openSet.pop_back();
+		}
+		gSink = gSink + sum;
+	});
+
+	RunBenchmark("closed_set/generation_stamp", map, 10000000, [&](int operations) {
+		SearchSpace<int>& space = search.mIntSearch;
+		space.Reset();
+		for (int i = 0; i < GLOBAL_CONST_BENCHMARK_SET_SIZE; i++)
+		{
+			space.closedIn[cells[i]] = space.generation;
+		}
+		long long found = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			found += space.closedIn[cells[i & 4095]] == space.generation;
+		}
+		gSink = gSink + found;
+	});
+
+	// A straight run of parents, walked back into the reused path vector
+	std::vector<int> parent(columns * rows);
+	for (int i = 0; i < GLOBAL_CONST_BENCHMARK_PATH_LENGTH; i++)
+	{
+		parent[i] = i > 0 ? i - 1 : 0;
+	}
+	RunBenchmark("retrace/parent_array", map, 1000000, [&](int operations) {
+		long long length = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			search.RetracePath(parent, 0, GLOBAL_CONST_BENCHMARK_PATH_LENGTH - 1);
+			length += search.mPath.size();
+		}
+		gSink = gSink + length;
+	});
+
+	// Pairs up to 32 nodes apart, the reach of a typical Theta* parent link
+	std::vector<int> targets(4096);
+	std::uniform_int_distribution<int> nearby(-32, 32);
+	for (size_t i = 0; i < targets.size(); i++)
+	{
+		const int x = std::max(0, std::min(columns - 1, cells[i] / rows + nearby(random)));
+		const int y = std::max(0, std::min(rows - 1, cells[i] % rows + nearby(random)));
+		targets[i] = x * rows + y;
+	}
+	RunBenchmark("line_of_sight/cut_corners", map, 200000, [&](int operations) {
+		long long sum = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			sum += search.LineOfSight<true>(cells[i & 4095], targets[i & 4095]);
+		}
+		gSink = gSink + sum;
+	});
+	RunBenchmark("line_of_sight/no_corner_cutting", map, 200000, [&](int operations) {
+		long long sum = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			sum += search.LineOfSight<false>(cells[i & 4095], targets[i & 4095]);
+		}
+		gSink = gSink + sum;
+	});
+
+	// Whole queries for context, the primitives above add up to most of this
+	RunQueryBenchmark("query/find_path_grid_octile_int", map, 64, grid, config, cells);
+
+	// Cooperative planning ticks of a crowd, each Step replans the agents that are due
+	CooperativePlanner planner;
+	planner.SetGrid(grid, config);
+	for (int i = 0; i < 200; i++)
+	{
+		planner.AddAgent(cells[i], cells[i + 2048]);
+	}
+	planner.Step();
+	RunBenchmark("cooperative/step_200_agents", map, 64, [&](int operations) {
+		for (int i = 0; i < operations; i++)
+		{
+			planner.Step();
+		}
+		gSink = gSink + planner.GetPosition(0);
+	});
+}
+
+// Wall distance upkeep under the editor's paint strokes against recomputing the whole map after each edit
+void RunDistanceMapBenchmarks(std::mt19937& random)
+{
+	const char* map = "256x256";
+	const int columns = GLOBAL_CONST_BENCHMARK_COLUMNS;
+	const int rows = GLOBAL_CONST_BENCHMARK_ROWS;
+	std::vector<unsigned char> walkable(columns * rows);
+	std::uniform_int_distribution<int> percent(0, 99);
+	for (unsigned char& cell:walkable)
+	{
+		cell = percent(random) >= GLOBAL_CONST_BENCHMARK_WALLS;
+	}
+	std::vector<unsigned char> walkableBits;
+	PackWalkableBits(walkable, walkableBits);
+	GridView grid = { columns, rows, &walkableBits[0], nullptr, TERRAIN_GROUND, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+	// Strokes are random walks of GLOBAL_CONST_BENCHMARK_PATH_LENGTH open nodes, the way a drag paints
+	std::vector<int> stroke;
+	std::uniform_int_distribution<int> anyX(0, columns - 1);
+	std::uniform_int_distribution<int> anyY(0, rows - 1);
+	std::uniform_int_distribution<int> step(-1, 1);
+	while (stroke.size() < 4096)
+	{
+		int x = anyX(random);
+		int y = anyY(random);
+		for (int i = 0; i < GLOBAL_CONST_BENCHMARK_PATH_LENGTH; i++)
+		{
+			x = std::max(0, std::min(columns - 1, x + step(random)));
+			y = std::max(0, std::min(rows - 1, y + step(random)));
+			const int id = x * rows + y;
+			if (walkable[id] && std::find(stroke.end() - std::min<size_t>(stroke.size(), i), stroke.end(), id) == stroke.end())
+			{
+				stroke.push_back(id);
+			}
+		}
+	}
+
+	DistanceMap distanceMap;
+	distanceMap.Reset(grid);
+	// An operation paints a node and erases it again, so each repetition starts from the same map
+	RunBenchmark("distance_map/paint_node", map, static_cast<int>(stroke.size()), [&](int operations) {
+		for (int i = 0; i < operations; i++)
+		{
+			distanceMap.SetWall(stroke[i], true);
+			distanceMap.Update();
+		}
+		for (int i = 0; i < operations; i++)
+		{
+			distanceMap.SetWall(stroke[i], false);
+			distanceMap.Update();
+		}
+		gSink = gSink + distanceMap.GetSquaredDistance(stroke[0]);
+	});
+	RunBenchmark("distance_map/paint_stroke_batched_node", map, static_cast<int>(stroke.size()), [&](int operations) {
+		for (int begin = 0; begin < operations; begin += GLOBAL_CONST_BENCHMARK_PATH_LENGTH)
+		{
+			const int end = std::min(operations, begin + GLOBAL_CONST_BENCHMARK_PATH_LENGTH);
+			for (int i = begin; i < end; i++)
+			{
+				distanceMap.SetWall(stroke[i], true);
+			}
+			distanceMap.Update();
+		}
+		for (int i = 0; i < operations; i++)
+		{
+			distanceMap.SetWall(stroke[i], false);
+		}
+		distanceMap.Update();
+		gSink = gSink + distanceMap.GetSquaredDistance(stroke[0]);
+	});
+	RunBenchmark("distance_map/full_rebuild", map, 16, [&](int operations) {
+		for (int i = 0; i < operations; i++)
+		{
+			distanceMap.Reset(grid);
+		}
+		gSink = gSink + distanceMap.GetSquaredDistance(stroke[0]);
+	});
+}
+
+// Perfect maze carved by a randomized depth first walk on the odd nodes, then opened up in a few
+// random places so there are loops. The kind of map where the octile heuristic has nothing to go on
+void MakeMaze(int columns, int rows, std::mt19937& random, std::vector<unsigned char>& walkable)
+{
+	static const int offsetX[4] = { 2, -2, 0, 0 };
+	static const int offsetY[4] = { 0, 0, 2, -2 };
+	walkable.assign(columns * rows, 0);
+	std::vector<int> stack(1, 1 * rows + 1);
+	walkable[stack[0]] = 1;
+	while (!stack.empty())
+	{
+		const int x = stack.back() / rows;
+		const int y = stack.back() % rows;
+		int directions[4];
+		int directionCount = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			const int nextX = x + offsetX[i];
+			const int nextY = y + offsetY[i];
+			if (nextX > 0 && nextX < columns - 1 && nextY > 0 && nextY < rows - 1 && !walkable[nextX * rows + nextY])
+			{
+				directions[directionCount++] = i;
+			}
+		}
+		if (directionCount == 0)
+		{
+			stack.pop_back();
+			continue;
+		}
+		const int direction = directions[std::uniform_int_distribution<int>(0, directionCount - 1)(random)];
+		walkable[(x + offsetX[direction] / 2) * rows + y + offsetY[direction] / 2] = 1;
+		stack.push_back((x + offsetX[direction]) * rows + y + offsetY[direction]);
+		walkable[stack.back()] = 1;
+	}
+	std::uniform_int_distribution<int> anyNode(0, columns * rows - 1);
+	for (int i = 0; i < columns * rows / 32; i++)
+	{
+		const int id = anyNode(random);
+		if (id / rows > 0 && id / rows < columns - 1 && id % rows > 0 && id % rows < rows - 1)
+		{
+			walkable[id] = 1;
+		}
+	}
+}
+
+// The landmark heuristic against octile on a maze, the table lookups alone and whole queries
+void RunLandmarkBenchmarks(std::mt19937& random)
+{
+	const char* map = "255x255_maze";
+	const int columns = GLOBAL_CONST_BENCHMARK_COLUMNS - 1;
+	const int rows = GLOBAL_CONST_BENCHMARK_ROWS - 1;
+	std::vector<unsigned char> walkable;
+	MakeMaze(columns, rows, random, walkable);
+	std::vector<unsigned char> walkableBits;
+	PackWalkableBits(walkable, walkableBits);
+	GridView grid = { columns, rows, &walkableBits[0], nullptr, TERRAIN_GROUND, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+	std::vector<int> cells = MakeQueryCells(walkable, random);
+
+	LandmarkTable landmarks;
+	RunBenchmark("landmarks/build_8_avoid", map, 1, [&](int operations) {
+		for (int i = 0; i < operations; i++)
+		{
+			landmarks.Build(grid, 8, LANDMARK_AVOID);
+		}
+		gSink = gSink + landmarks.GetLandmarks()[0];
+	});
+	grid.landmarks = &landmarks;
+	RunBenchmark("heuristic/landmarks_8", map, 10000000, [&](int operations) {
+		long long sum = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			sum += landmarks.Estimate(cells[i & 4095], cells[(i + 7) & 4095]);
+		}
+		gSink = gSink + sum;
+	});
+
+	SearchConfig config = MakeDefaultSearchConfig();
+	RunQueryBenchmark("query/find_path_maze_octile_int", map, 64, grid, config, cells);
+	config.heuristic = HEURISTIC_LANDMARKS;
+	RunQueryBenchmark("query/find_path_maze_landmarks_int", map, 64, grid, config, cells);
+}
+
+// Same maze and queries as the landmark benchmarks, so the query rows compare directly
+void RunContractionBenchmarks(std::mt19937& random)
+{
+	const char* map = "255x255_maze";
+	const int columns = GLOBAL_CONST_BENCHMARK_COLUMNS - 1;
+	const int rows = GLOBAL_CONST_BENCHMARK_ROWS - 1;
+	std::vector<unsigned char> walkable;
+	MakeMaze(columns, rows, random, walkable);
+	std::vector<unsigned char> walkableBits;
+	PackWalkableBits(walkable, walkableBits);
+	GridView grid = { columns, rows, &walkableBits[0], nullptr, TERRAIN_GROUND, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+	std::vector<int> cells = MakeQueryCells(walkable, random);
+
+	SearchConfig config = MakeDefaultSearchConfig();
+	ContractionHierarchy hierarchy;
+	RunBenchmark("contraction/build_1_thread", map, 1, [&](int operations) {
+		for (int i = 0; i < operations; i++)
+		{
+			hierarchy.Build(grid, config, 1);
+		}
+		gSink = gSink + hierarchy.GetStats().shortcuts;
+	});
+	grid.contraction = &hierarchy;
+
+	RunQueryBenchmark("query/find_path_maze_contraction_int", map, 64, grid, config, cells);
+}
+
+// A Dijkstra per node makes the build quadratic, so the database gets a quarter of the maze the
+// other preprocessed searches run on. Octile A* runs the same queries for comparison
+void RunPathDatabaseBenchmarks(std::mt19937& random)
+{
+	const char* map = "127x127_maze";
+	const int columns = GLOBAL_CONST_BENCHMARK_COLUMNS / 2 - 1;
+	const int rows = GLOBAL_CONST_BENCHMARK_ROWS / 2 - 1;
+	std::vector<unsigned char> walkable;
+	MakeMaze(columns, rows, random, walkable);
+	std::vector<unsigned char> walkableBits;
+	PackWalkableBits(walkable, walkableBits);
+	GridView grid = { columns, rows, &walkableBits[0], nullptr, TERRAIN_GROUND, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+	std::vector<int> cells = MakeQueryCells(walkable, random);
+
+	SearchConfig config = MakeDefaultSearchConfig();
+	PathDatabase database;
+	RunBenchmark("path_database/build_dfs_1_thread", map, 1, [&](int operations) {
+		for (int i = 0; i < operations; i++)
+		{
+			database.Build(grid, config, TARGET_ORDER_DFS, 1);
+		}
+		gSink = gSink + database.GetStats().runs;
+	});
+	RunBenchmark("path_database/first_move", map, 10000000, [&](int operations) {
+		long long sum = 0;
+		for (int i = 0; i < operations; i++)
+		{
+			sum += database.GetFirstMove(cells[i & 4095], cells[(i + 7) & 4095]);
+		}
+		gSink = gSink + sum;
+	});
+
+	RunQueryBenchmark("query/find_path_small_maze_octile_int", map, 64, grid, config, cells);
+	grid.pathDatabase = &database;
+	RunQueryBenchmark("query/find_path_small_maze_path_database_int", map, 64, grid, config, cells);
+}
+
+// Random rectangles of wall up to 8 nodes a side over a quarter of the map, the open ground with few
+// wall corners subgoal graphs are meant for
+void MakeBlocks(int columns, int rows, std::mt19937& random, std::vector<unsigned char>& walkable)
+{
+	walkable.assign(columns * rows, 1);
+	std::uniform_int_distribution<int> anyColumn(0, columns - 1);
+	std::uniform_int_distribution<int> anyRow(0, rows - 1);
+	std::uniform_int_distribution<int> anySide(1, 8);
+	for (int i = 0; i < columns * rows / 80; i++)
+	{
+		const int x = anyColumn(random);
+		const int y = anyRow(random);
+		const int width = anySide(random);
+		const int height = anySide(random);
+		for (int blockX = x; blockX < std::min(x + width, columns); blockX++)
+		{
+			for (int blockY = y; blockY < std::min(y + height, rows); blockY++)
+			{
+				walkable[blockX * rows + blockY] = 0;
+			}
+		}
+	}
+}
+
+// Both levels of subgoal graph against octile A* on the same queries, without corner cutting
+void RunSubgoalBenchmarks(std::mt19937& random)
+{
+	const char* map = "256x256_blocks";
+	const int columns = GLOBAL_CONST_BENCHMARK_COLUMNS;
+	const int rows = GLOBAL_CONST_BENCHMARK_ROWS;
+	std::vector<unsigned char> walkable;
+	MakeBlocks(columns, rows, random, walkable);
+	std::vector<unsigned char> walkableBits;
+	PackWalkableBits(walkable, walkableBits);
+	GridView grid = { columns, rows, &walkableBits[0], nullptr, TERRAIN_GROUND, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+	std::vector<int> cells = MakeQueryCells(walkable, random);
+
+	SearchConfig config = MakeDefaultSearchConfig();
+	config.cutCorners = false;
+	RunQueryBenchmark("query/find_path_blocks_octile_int", map, 64, grid, config, cells);
+
+	SubgoalGraph simple;
+	RunBenchmark("subgoal/build_simple", map, 4, [&](int operations) {
+		for (int i = 0; i < operations; i++)
+		{
+			simple.Build(grid, SUBGOAL_SIMPLE);
+		}
+		gSink = gSink + simple.GetStats().edges;
+	});
+	grid.subgoals = &simple;
+	RunQueryBenchmark("query/find_path_blocks_subgoal_simple_int", map, 256, grid, config, cells);
+
+	SubgoalGraph twoLevel;
+	RunBenchmark("subgoal/build_two_level", map, 1, [&](int operations) {
+		for (int i = 0; i < operations; i++)
+		{
+			twoLevel.Build(grid, SUBGOAL_TWO_LEVEL);
+		}
+		gSink = gSink + twoLevel.GetStats().edges;
+	});
+	grid.subgoals = &twoLevel;
+	RunQueryBenchmark("query/find_path_blocks_subgoal_two_level_int", map, 256, grid, config, cells);
+}
+
+int main()
+{
+	std::mt19937 random(GLOBAL_CONST_BENCHMARK_SEED);
+	RunLegacyBenchmarks(random);
+	PathSearchBenchmark::Run(random);
+	RunDistanceMapBenchmarks(random);
+	RunLandmarkBenchmarks(random);
+	RunContractionBenchmarks(random);
+	RunPathDatabaseBenchmarks(random);
+	RunSubgoalBenchmarks(random);
+
+	printf("{\n\t\"seed\": %u,\n\t\"benchmarks\": [\n", GLOBAL_CONST_BENCHMARK_SEED);
+	for (size_t i = 0; i < gResults.size(); i++)
+	{
+		const BenchmarkResult& result = gResults[i];
+		printf("\t\t{ \"name\": \"%s\", \"map\": \"%s\", \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f }%s\n",
+			result.name.c_str(),
+			result.map.c_str(),
+			result.nsPerOp,
+			result.allocsPerOp,
+			i + 1 < gResults.size() ? "," : "");
+	}
+	printf("\t]\n}\n");
+	return 0;
+}
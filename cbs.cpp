@@ -0,0 +1,754 @@
+#include "cbs.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Longest .scen line accepted, map names included
+const int GLOBAL_CONST_SCENARIO_MAX_LINE = 1024;
+
+// Unit cost distance to the goal from every node, the low level heuristic. Steps are symmetric, so a
+// breadth first search out from the goal gives the distance of every node to it
+static void ComputeStepDistances(const GridView& grid, const SearchConfig& config, int goal, std::vector<int>& distance)
+{
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	distance.assign(grid.columns * grid.rows, CostTraits<int>::Infinity());
+	std::vector<int> queue;
+	queue.push_back(goal);
+	distance[goal] = 0;
+	for (size_t i = 0; i < queue.size(); i++)
+	{
+		const int x = queue[i] / grid.rows;
+		const int y = queue[i] % grid.rows;
+		for (int direction = 0; direction < config.connectivity; direction++)
+		{
+			const int neighborX = x + offsetX[direction];
+			const int neighborY = y + offsetY[direction];
+			if (!grid.CanStep(x, y, neighborX, neighborY, config.cutCorners))
+			{
+				continue;
+			}
+			const int neighbor = grid.GetCellId(neighborX, neighborY);
+			if (distance[neighbor] == CostTraits<int>::Infinity())
+			{
+				distance[neighbor] = distance[queue[i]] + 1;
+				queue.push_back(neighbor);
+			}
+		}
+	}
+}
+
+// Whether a constraint forbids the step from -> to that ends at time, waits included
+static bool IsConstrained(const std::vector<CbsConstraint>& constraints, int from, int to, int time)
+{
+	for (const CbsConstraint& constraint:constraints)
+	{
+		if (constraint.time == time &&
+			((constraint.nextNode < 0 && constraint.node == to) || (constraint.node == from && constraint.nextNode == to)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Node an agent is on at a tick, it stays on its goal once the path ends
+static int GetPathNode(const std::vector<int>& path, int time)
+{
+	return path[std::min(time, static_cast<int>(path.size()) - 1)];
+}
+
+// First tick the two paths collide, false when they never do
+static bool FindFirstConflict(const std::vector<int>& a, const std::vector<int>& b, int agentA, int agentB, CbsConflict& conflict)
+{
+	const int end = static_cast<int>(std::max(a.size(), b.size()));
+	for (int time = 1; time < end; time++)
+	{
+		const int nodeA = GetPathNode(a, time);
+		const int nodeB = GetPathNode(b, time);
+		const int previousA = GetPathNode(a, time - 1);
+		if (nodeA == nodeB)
+		{
+			CbsConflict vertex = { agentA, agentB, nodeA, -1, time };
+			conflict = vertex;
+			return true;
+		}
+		if (nodeA == GetPathNode(b, time - 1) && nodeB == previousA)
+		{
+			CbsConflict edge = { agentA, agentB, previousA, nodeA, time };
+			conflict = edge;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LoadMovingAiMap(const char* path, std::vector<unsigned char>& walkable, int& columns, int& rows)
+{
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+	{
+		PathfindingLog("Failed to open map %s", path);
+		return false;
+	}
+
+	// Header of "key value" pairs, ended by the word map
+	char key[64];
+	columns = 0;
+	rows = 0;
+	while (fscanf(file, " %63s", key) == 1 && std::strcmp(key, "map") != 0)
+	{
+		int value = 0;
+		if (std::strcmp(key, "height") == 0 && fscanf(file, "%d", &value) == 1)
+		{
+			rows = value;
+		}
+		else if (std::strcmp(key, "width") == 0 && fscanf(file, "%d", &value) == 1)
+		{
+			columns = value;
+		}
+		else if (std::strcmp(key, "type") == 0 && fscanf(file, " %63s", key) != 1)
+		{
+			break;
+		}
+	}
+	if (columns <= 0 || rows <= 0)
+	{
+		PathfindingLog("Map %s has no valid size", path);
+		fclose(file);
+		return false;
+	}
+
+	walkable.assign(columns * rows, 0);
+	std::vector<char> line(columns + 1);
+	char format[32];
+	snprintf(format, sizeof(format), " %%%ds", columns);
+	for (int y = 0; y < rows; y++)
+	{
+		if (fscanf(file, format, &line[0]) != 1 || static_cast<int>(std::strlen(&line[0])) != columns)
+		{
+			PathfindingLog("Map %s is missing row %d", path, y);
+			fclose(file);
+			return false;
+		}
+		for (int x = 0; x < columns; x++)
+		{
+			const char cell = line[x];
+			walkable[x * rows + y] = cell == '.' || cell == 'G' || cell == 'S';
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+bool LoadMovingAiScenario(const char* path, int columns, int rows, std::vector<MapfAgent>& agents)
+{
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+	{
+		PathfindingLog("Failed to open scenario %s", path);
+		return false;
+	}
+
+	// Lines of "bucket map width height startX startY goalX goalY optimalLength" after the version line
+	agents.clear();
+	char line[GLOBAL_CONST_SCENARIO_MAX_LINE];
+	char mapName[GLOBAL_CONST_SCENARIO_MAX_LINE];
+	int lineNumber = 0;
+	while (fgets(line, sizeof(line), file) != nullptr)
+	{
+		lineNumber++;
+		int bucket, width, height, startX, startY, goalX, goalY;
+		if (std::strncmp(line, "version", 7) == 0)
+		{
+			continue;
+		}
+		if (sscanf(line, "%d %s %d %d %d %d %d %d", &bucket, mapName, &width, &height, &startX, &startY, &goalX, &goalY) != 8)
+		{
+			continue;
+		}
+		if (width != columns || height != rows ||
+			startX < 0 || startX >= columns || startY < 0 || startY >= rows ||
+			goalX < 0 || goalX >= columns || goalY < 0 || goalY >= rows)
+		{
+			PathfindingLog("Scenario %s line %d does not fit a %dx%d map", path, lineNumber, columns, rows);
+			fclose(file);
+			return false;
+		}
+		MapfAgent agent = { startX * rows + startY, goalX * rows + goalY };
+		agents.push_back(agent);
+	}
+	fclose(file);
+	return true;
+}
+
+CbsOptions MakeDefaultCbsOptions()
+{
+	CbsOptions options;
+	options.bypass = true;
+	options.prioritizeConflicts = true;
+	options.maxNodes = 0;
+	options.timeLimitMs = 60000.0;
+	return options;
+}
+
+CbsLowLevel::CbsLowLevel()
+{
+	mMarkGeneration = 0;
+	mExpanded = 0;
+}
+
+// A* over (node, tick). The heuristic is the exact unit distance ignoring the other agents, so it is consistent.
+// Past the last constrained tick waiting never helps, so those ticks share a state per node and the search ends
+bool CbsLowLevel::FindPath(const GridView& grid, const SearchConfig& config, const std::vector<int>& distance,
+	const MapfAgent& agent, const std::vector<CbsConstraint>& constraints, std::vector<int>& path)
+{
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	path.clear();
+	if (distance[agent.start] == CostTraits<int>::Infinity())
+	{
+		return false;
+	}
+
+	// The agent may only finish once nothing forbids its goal any more
+	int lastConstraintTime = 0;
+	int goalFreeFrom = 0;
+	for (const CbsConstraint& constraint:constraints)
+	{
+		lastConstraintTime = std::max(lastConstraintTime, constraint.time);
+		if (constraint.nextNode < 0 && constraint.node == agent.goal)
+		{
+			goalFreeFrom = std::max(goalFreeFrom, constraint.time + 1);
+		}
+	}
+	const uint64_t nodeCount = static_cast<uint64_t>(grid.columns) * grid.rows;
+	const int collapsedTime = lastConstraintTime + 1;
+
+	mStates.clear();
+	mStateIndex.clear();
+	mOpenSet.clear();
+	OpenEntryGreater<int> greater;
+	State start = { agent.start, 0, -1 };
+	mStates.push_back(start);
+	mStateIndex[agent.start] = 0;
+	OpenEntry<int> startEntry = { distance[agent.start], distance[agent.start], 0 };
+	mOpenSet.push_back(startEntry);
+
+	while (mOpenSet.size() > 0)
+	{
+		std::pop_heap(mOpenSet.begin(), mOpenSet.end(), greater);
+		const int id = mOpenSet.back().id;
+		mOpenSet.pop_back();
+		const State state = mStates[id];
+		// Stale entry, the state was reached earlier since
+		if (mStateIndex[std::min(state.time, collapsedTime) * nodeCount + state.node] != id)
+		{
+			continue;
+		}
+		mExpanded++;
+
+		if (state.node == agent.goal && state.time >= goalFreeFrom)
+		{
+			path.resize(state.time + 1);
+			for (int walk = id; walk >= 0; walk = mStates[walk].parent)
+			{
+				path[mStates[walk].time] = mStates[walk].node;
+			}
+			return true;
+		}
+
+		const int x = state.node / grid.rows;
+		const int y = state.node % grid.rows;
+		const int time = state.time + 1;
+		for (int i = -1; i < config.connectivity; i++)
+		{
+			const int neighborX = i < 0 ? x : x + offsetX[i];
+			const int neighborY = i < 0 ? y : y + offsetY[i];
+			if (i >= 0 && !grid.CanStep(x, y, neighborX, neighborY, config.cutCorners))
+			{
+				continue;
+			}
+			const int neighbor = grid.GetCellId(neighborX, neighborY);
+			if (IsConstrained(constraints, state.node, neighbor, time))
+			{
+				continue;
+			}
+
+			const uint64_t key = std::min(time, collapsedTime) * nodeCount + neighbor;
+			std::unordered_map<uint64_t, int>::iterator known = mStateIndex.find(key);
+			if (known != mStateIndex.end() && mStates[known->second].time <= time)
+			{
+				continue;
+			}
+			State next = { neighbor, time, id };
+			mStates.push_back(next);
+			const int nextId = static_cast<int>(mStates.size()) - 1;
+			mStateIndex[key] = nextId;
+			OpenEntry<int> entry = { time + distance[neighbor], distance[neighbor], nextId };
+			mOpenSet.push_back(entry);
+			std::push_heap(mOpenSet.begin(), mOpenSet.end(), greater);
+		}
+	}
+	return false;
+}
+
+// Forward pass collects the nodes reachable at each tick that can still make the goal in time,
+// the backward pass keeps the ones that actually lead to it. A level of one node is a node every optimal path takes
+void CbsLowLevel::BuildMdd(const GridView& grid, const SearchConfig& config, const std::vector<int>& distance,
+	const MapfAgent& agent, const std::vector<CbsConstraint>& constraints, int cost, std::vector<std::vector<int> >& levels)
+{
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	mMark.resize(grid.columns * grid.rows, 0);
+	levels.assign(cost + 1, std::vector<int>());
+	levels[0].push_back(agent.start);
+	for (int time = 0; time < cost; time++)
+	{
+		mMarkGeneration++;
+		for (int node:levels[time])
+		{
+			const int x = node / grid.rows;
+			const int y = node % grid.rows;
+			for (int i = -1; i < config.connectivity; i++)
+			{
+				const int neighborX = i < 0 ? x : x + offsetX[i];
+				const int neighborY = i < 0 ? y : y + offsetY[i];
+				if (i >= 0 && !grid.CanStep(x, y, neighborX, neighborY, config.cutCorners))
+				{
+					continue;
+				}
+				const int neighbor = grid.GetCellId(neighborX, neighborY);
+				if (mMark[neighbor] == mMarkGeneration || time + 1 + distance[neighbor] > cost ||
+					IsConstrained(constraints, node, neighbor, time + 1))
+				{
+					continue;
+				}
+				mMark[neighbor] = mMarkGeneration;
+				levels[time + 1].push_back(neighbor);
+			}
+		}
+	}
+
+	levels[cost].assign(1, agent.goal);
+	for (int time = cost - 1; time >= 0; time--)
+	{
+		mMarkGeneration++;
+		for (int node:levels[time + 1])
+		{
+			mMark[node] = mMarkGeneration;
+		}
+		int kept = 0;
+		for (int node:levels[time])
+		{
+			const int x = node / grid.rows;
+			const int y = node % grid.rows;
+			bool leadsOn = false;
+			for (int i = -1; i < config.connectivity && !leadsOn; i++)
+			{
+				const int neighborX = i < 0 ? x : x + offsetX[i];
+				const int neighborY = i < 0 ? y : y + offsetY[i];
+				if (i >= 0 && !grid.CanStep(x, y, neighborX, neighborY, config.cutCorners))
+				{
+					continue;
+				}
+				const int neighbor = grid.GetCellId(neighborX, neighborY);
+				leadsOn = mMark[neighbor] == mMarkGeneration && !IsConstrained(constraints, node, neighbor, time + 1);
+			}
+			if (leadsOn)
+			{
+				levels[time][kept++] = node;
+			}
+		}
+		levels[time].resize(kept);
+	}
+}
+
+CbsSolver::CbsSolver(int threadCount)
+{
+	mBatch = nullptr;
+	mNext = 0;
+	mRemaining = 0;
+	mStopping = false;
+	mGrid = GridView();
+	mConfig = MakeDefaultSearchConfig();
+	mOptions = MakeDefaultCbsOptions();
+	mAgents = nullptr;
+	mStats = CbsStats();
+	for (int i = 0; i < std::max(1, threadCount); i++)
+	{
+		mWorkers.push_back(std::thread(&CbsSolver::WorkerLoop, this));
+	}
+}
+
+CbsSolver::~CbsSolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWake.notify_all();
+	for (std::thread& worker:mWorkers)
+	{
+		worker.join();
+	}
+}
+
+bool CbsSolver::Solve(const GridView& grid, const SearchConfig& config, const std::vector<MapfAgent>& agents,
+	const CbsOptions& options, std::vector<std::vector<int> >& paths)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	mStats = CbsStats();
+	paths.clear();
+	mGrid = grid;
+	mConfig = config;
+	mOptions = options;
+	mAgents = &agents;
+	mNodes.clear();
+	mOpen.clear();
+
+	// The root plans every agent on its own
+	Node root;
+	root.parent = -1;
+	CbsConstraint none = { -1, -1, -1, -1 };
+	root.constraint = none;
+	root.cost = 0;
+	mDistances.resize(agents.size());
+	const std::vector<CbsConstraint> noConstraints;
+	const long long rootExpandedBefore = mRootSearch.GetExpanded();
+	for (size_t agent = 0; agent < agents.size(); agent++)
+	{
+		ComputeStepDistances(grid, config, agents[agent].goal, mDistances[agent]);
+		std::vector<int> path;
+		if (!mRootSearch.FindPath(grid, config, mDistances[agent], agents[agent], noConstraints, path))
+		{
+			PathfindingLog("Agent %d cannot reach its goal", static_cast<int>(agent));
+			mStats.solveMs = GetElapsedMs(begin);
+			return false;
+		}
+		root.cost += static_cast<int>(path.size()) - 1;
+		root.agents.push_back(static_cast<int>(agent));
+		root.paths.push_back(path);
+	}
+	mNodes.push_back(root);
+	std::vector<const std::vector<int>*> rootPaths;
+	GetPaths(0, rootPaths);
+	mNodes[0].conflicts = CountConflicts(rootPaths);
+	mStats.lowerBound = root.cost;
+	mStats.nodesGenerated = 1;
+	mStats.lowLevelExpanded = mRootSearch.GetExpanded() - rootExpandedBefore;
+	PushNode(0);
+
+	OpenGreater greater(mNodes);
+	std::vector<Expansion> batch;
+	while (!mOpen.empty())
+	{
+		if ((mOptions.maxNodes > 0 && mStats.nodesExpanded >= mOptions.maxNodes) ||
+			(mOptions.timeLimitMs > 0.0 && GetElapsedMs(begin) > mOptions.timeLimitMs))
+		{
+			break;
+		}
+
+		// The cheapest node is only a solution once nothing cheaper is left to expand
+		const int best = mOpen.front();
+		if (mNodes[best].conflicts == 0)
+		{
+			std::vector<const std::vector<int>*> solution;
+			GetPaths(best, solution);
+			for (const std::vector<int>* path:solution)
+			{
+				paths.push_back(*path);
+				mStats.makespan = std::max(mStats.makespan, static_cast<int>(path->size()) - 1);
+			}
+			mStats.solved = true;
+			mStats.sumOfCosts = mNodes[best].cost;
+			mStats.solveMs = GetElapsedMs(begin);
+			return true;
+		}
+
+		// A batch of the cheapest conflicted nodes, one per worker
+		batch.clear();
+		while (!mOpen.empty() && batch.size() < mWorkers.size() && mNodes[mOpen.front()].conflicts > 0)
+		{
+			std::pop_heap(mOpen.begin(), mOpen.end(), greater);
+			Expansion expansion;
+			expansion.node = mOpen.back();
+			mOpen.pop_back();
+			batch.push_back(expansion);
+		}
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mBatch = &batch;
+			mNext = 0;
+			mRemaining = batch.size();
+			mWake.notify_all();
+			mDone.wait(lock, [this]() { return mRemaining == 0; });
+			mBatch = nullptr;
+		}
+
+		// Back on this thread only, so the tree can grow again
+		for (Expansion& expansion:batch)
+		{
+			Node& node = mNodes[expansion.node];
+			for (size_t i = 0; i < expansion.bypassAgents.size(); i++)
+			{
+				std::vector<int>::iterator own = std::find(node.agents.begin(), node.agents.end(), expansion.bypassAgents[i]);
+				if (own != node.agents.end())
+				{
+					node.paths[own - node.agents.begin()].swap(expansion.bypassPaths[i]);
+				}
+				else
+				{
+					node.agents.push_back(expansion.bypassAgents[i]);
+					node.paths.push_back(expansion.bypassPaths[i]);
+				}
+			}
+			node.conflicts = expansion.conflicts;
+			mStats.nodesExpanded++;
+			mStats.bypasses += expansion.bypasses;
+			mStats.cardinalSplits += expansion.cardinal;
+			mStats.lowLevelExpanded += expansion.lowLevelExpanded;
+
+			// Bypassing can clear every conflict, the node then waits its turn as a solution
+			if (node.conflicts == 0)
+			{
+				PushNode(expansion.node);
+				continue;
+			}
+			for (Node& child:expansion.children)
+			{
+				mNodes.push_back(Node());
+				mNodes.back().parent = child.parent;
+				mNodes.back().constraint = child.constraint;
+				mNodes.back().agents.swap(child.agents);
+				mNodes.back().paths.swap(child.paths);
+				mNodes.back().cost = child.cost;
+				mNodes.back().conflicts = child.conflicts;
+				PushNode(static_cast<int>(mNodes.size()) - 1);
+				mStats.nodesGenerated++;
+			}
+		}
+	}
+
+	mStats.solveMs = GetElapsedMs(begin);
+	return false;
+}
+
+// Runs on a worker, reads the tree and writes only to the expansion
+void CbsSolver::Expand(CbsLowLevel& lowLevel, Expansion& expansion)
+{
+	const long long expandedBefore = lowLevel.GetExpanded();
+	const Node& node = mNodes[expansion.node];
+	const std::vector<MapfAgent>& agents = *mAgents;
+	std::vector<const std::vector<int>*> paths;
+	GetPaths(expansion.node, paths);
+
+	// Bypassed paths are pointed at from paths, so the storage must not move
+	expansion.bypassPaths.reserve(agents.size());
+	expansion.conflicts = node.conflicts;
+	expansion.bypasses = 0;
+	expansion.cardinal = false;
+
+	std::vector<CbsConstraint> constraints;
+	std::vector<int> childPath;
+	CbsConflict conflict;
+	bool cardinal = false;
+	while (ChooseConflict(lowLevel, expansion.node, paths, conflict, cardinal))
+	{
+		expansion.children.clear();
+		bool bypassed = false;
+		for (int side = 0; side < 2 && !bypassed; side++)
+		{
+			const int agent = side == 0 ? conflict.agentA : conflict.agentB;
+			CbsConstraint constraint = { agent, conflict.node, -1, conflict.time };
+			if (conflict.nextNode >= 0 && side == 1)
+			{
+				// The other agent's step runs the opposite way
+				constraint.node = conflict.nextNode;
+				constraint.nextNode = conflict.node;
+			}
+			else if (conflict.nextNode >= 0)
+			{
+				constraint.nextNode = conflict.nextNode;
+			}
+			GetConstraints(expansion.node, agent, constraints);
+			constraints.push_back(constraint);
+			if (!lowLevel.FindPath(mGrid, mConfig, mDistances[agent], agents[agent], constraints, childPath))
+			{
+				continue;
+			}
+
+			const int childCost = node.cost - static_cast<int>(paths[agent]->size()) + static_cast<int>(childPath.size());
+			const std::vector<int>* parentPath = paths[agent];
+			paths[agent] = &childPath;
+			const int childConflicts = CountConflicts(paths);
+			paths[agent] = parentPath;
+
+			// Same cost and fewer conflicts, the node keeps the path instead of splitting
+			if (mOptions.bypass && childCost == node.cost && childConflicts < expansion.conflicts)
+			{
+				std::vector<int>::iterator own = std::find(expansion.bypassAgents.begin(), expansion.bypassAgents.end(), agent);
+				if (own == expansion.bypassAgents.end())
+				{
+					expansion.bypassAgents.push_back(agent);
+					expansion.bypassPaths.push_back(childPath);
+					paths[agent] = &expansion.bypassPaths.back();
+				}
+				else
+				{
+					expansion.bypassPaths[own - expansion.bypassAgents.begin()] = childPath;
+				}
+				expansion.conflicts = childConflicts;
+				expansion.bypasses++;
+				bypassed = true;
+				continue;
+			}
+
+			Node child;
+			child.parent = expansion.node;
+			child.constraint = constraint;
+			child.agents.push_back(agent);
+			child.paths.push_back(childPath);
+			child.cost = childCost;
+			child.conflicts = childConflicts;
+			expansion.children.push_back(child);
+		}
+		if (!bypassed)
+		{
+			expansion.cardinal = cardinal;
+			break;
+		}
+	}
+	if (expansion.conflicts == 0)
+	{
+		expansion.children.clear();
+	}
+	expansion.lowLevelExpanded = lowLevel.GetExpanded() - expandedBefore;
+}
+
+// Current path of every agent at a node, each from the nearest node that replanned it
+void CbsSolver::GetPaths(int node, std::vector<const std::vector<int>*>& paths) const
+{
+	paths.assign(mAgents->size(), nullptr);
+	for (int walk = node; walk >= 0; walk = mNodes[walk].parent)
+	{
+		const Node& ancestor = mNodes[walk];
+		for (size_t i = 0; i < ancestor.agents.size(); i++)
+		{
+			if (paths[ancestor.agents[i]] == nullptr)
+			{
+				paths[ancestor.agents[i]] = &ancestor.paths[i];
+			}
+		}
+	}
+}
+
+void CbsSolver::GetConstraints(int node, int agent, std::vector<CbsConstraint>& constraints) const
+{
+	constraints.clear();
+	for (int walk = node; walk >= 0; walk = mNodes[walk].parent)
+	{
+		if (mNodes[walk].constraint.agent == agent)
+		{
+			constraints.push_back(mNodes[walk].constraint);
+		}
+	}
+}
+
+// A conflict is cardinal for an agent when every optimal path of it passes the conflict, so either
+// child costs more. Splitting on cardinal conflicts first raises the tree's cost bound fastest
+bool CbsSolver::ChooseConflict(CbsLowLevel& lowLevel, int node, const std::vector<const std::vector<int>*>& paths, CbsConflict& conflict, bool& cardinal)
+{
+	const int agentCount = static_cast<int>(paths.size());
+	std::vector<std::vector<std::vector<int> > > mdds(agentCount);
+	std::vector<CbsConstraint> constraints;
+	int bestRank = -1;
+	for (int a = 0; a < agentCount; a++)
+	{
+		for (int b = a + 1; b < agentCount; b++)
+		{
+			CbsConflict candidate;
+			if (!FindFirstConflict(*paths[a], *paths[b], a, b, candidate))
+			{
+				continue;
+			}
+
+			int rank = 0;
+			for (int side = 0; side < 2 && mOptions.prioritizeConflicts; side++)
+			{
+				const int agent = side == 0 ? a : b;
+				const int cost = static_cast<int>(paths[agent]->size()) - 1;
+				// Sitting on its goal, any constraint there delays the agent
+				if (candidate.time > cost)
+				{
+					rank++;
+					continue;
+				}
+				if (mdds[agent].empty())
+				{
+					GetConstraints(node, agent, constraints);
+					lowLevel.BuildMdd(mGrid, mConfig, mDistances[agent], (*mAgents)[agent], constraints, cost, mdds[agent]);
+				}
+				const std::vector<std::vector<int> >& levels = mdds[agent];
+				rank += levels[candidate.time].size() == 1 && (candidate.nextNode < 0 || levels[candidate.time - 1].size() == 1);
+			}
+
+			if (rank > bestRank || (rank == bestRank && candidate.time < conflict.time))
+			{
+				bestRank = rank;
+				conflict = candidate;
+			}
+		}
+	}
+	cardinal = bestRank == 2;
+	return bestRank >= 0;
+}
+
+// Pairs of agents that collide at least once
+int CbsSolver::CountConflicts(const std::vector<const std::vector<int>*>& paths) const
+{
+	int conflicts = 0;
+	CbsConflict conflict;
+	for (size_t a = 0; a < paths.size(); a++)
+	{
+		for (size_t b = a + 1; b < paths.size(); b++)
+		{
+			conflicts += FindFirstConflict(*paths[a], *paths[b], static_cast<int>(a), static_cast<int>(b), conflict);
+		}
+	}
+	return conflicts;
+}
+
+void CbsSolver::PushNode(int node)
+{
+	mOpen.push_back(node);
+	std::push_heap(mOpen.begin(), mOpen.end(), OpenGreater(mNodes));
+}
+
+// Workers pull one node at a time, expansions differ a lot in cost
+void CbsSolver::WorkerLoop()
+{
+	CbsLowLevel lowLevel;
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mWake.wait(lock, [this]() { return mStopping || (mBatch != nullptr && mNext < mBatch->size()); });
+		if (mStopping)
+		{
+			return;
+		}
+
+		Expansion& expansion = (*mBatch)[mNext++];
+		lock.unlock();
+		Expand(lowLevel, expansion);
+		lock.lock();
+		if (--mRemaining == 0)
+		{
+			mDone.notify_one();
+		}
+	}
+}
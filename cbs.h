@@ -0,0 +1,198 @@
+// Optimal multi-agent path finding with Conflict-Based Search, and the MAPF benchmark instance formats
+#ifndef CBS_H
+#define CBS_H
+
+#include "pathfinding.h"
+
+#include <unordered_map>
+#include <vector>
+
+// One agent of a MAPF instance, as node ids
+struct MapfAgent
+{
+	int start;
+	int goal;
+};
+
+// Reads a MovingAI benchmark .map, '.', 'G' and 'S' are walkable and everything else is a wall
+bool LoadMovingAiMap(const char* path, std::vector<unsigned char>& walkable, int& columns, int& rows);
+// Reads the agents of a MovingAI .scen in file order, the scenario has to be for a map of that size
+bool LoadMovingAiScenario(const char* path, int columns, int rows, std::vector<MapfAgent>& agents);
+
+// Forbids an agent from a node at a tick, or from the step between two nodes that ends at that tick
+struct CbsConstraint
+{
+	int agent;
+	int node;
+	// -1 for a node constraint
+	int nextNode;
+	int time;
+};
+
+// Two agents on the same node at the same tick, or swapping nodes during the same tick
+struct CbsConflict
+{
+	int agentA;
+	int agentB;
+	int node;
+	// -1 for a node conflict, otherwise agentA steps node -> nextNode while agentB steps back
+	int nextNode;
+	int time;
+};
+
+struct CbsOptions
+{
+	// Adopt a child path instead of splitting when it costs the same and removes conflicts
+	bool bypass;
+	// Split on cardinal conflicts first, then semi-cardinal ones, classified with MDDs
+	bool prioritizeConflicts;
+	// The search gives up past either limit, 0 means no limit
+	int maxNodes;
+	double timeLimitMs;
+};
+
+CbsOptions MakeDefaultCbsOptions();
+
+// Counters of one Solve
+struct CbsStats
+{
+	bool solved;
+	int sumOfCosts;
+	int makespan;
+	// Sum of the single agent optimal costs, the cost of the root node
+	int lowerBound;
+	int nodesExpanded;
+	int nodesGenerated;
+	int bypasses;
+	int cardinalSplits;
+	long long lowLevelExpanded;
+	double solveMs;
+};
+
+// Space time A* for one agent, honoring the constraints of a constraint tree node.
+// Every action takes a tick and costs 1, agents stay on their goal once they are done
+class CbsLowLevel
+{
+public:
+	CbsLowLevel();
+
+	// Fills path with a node per tick up to the last arrival on the goal
+	bool FindPath(const GridView& grid, const SearchConfig& config, const std::vector<int>& distance,
+		const MapfAgent& agent, const std::vector<CbsConstraint>& constraints, std::vector<int>& path);
+	// Multi-valued decision diagram of the optimal paths of that cost, as the nodes the agent can be on at each tick
+	void BuildMdd(const GridView& grid, const SearchConfig& config, const std::vector<int>& distance,
+		const MapfAgent& agent, const std::vector<CbsConstraint>& constraints, int cost, std::vector<std::vector<int> >& levels);
+	long long GetExpanded() const { return mExpanded; }
+
+private:
+	struct State
+	{
+		int node;
+		int time;
+		int parent;
+	};
+
+	std::vector<State> mStates;
+	// Keyed by time * node count + node, times past the last constraint share one key
+	std::unordered_map<uint64_t, int> mStateIndex;
+	std::vector<OpenEntry<int> > mOpenSet;
+	std::vector<unsigned int> mMark;
+	unsigned int mMarkGeneration;
+	long long mExpanded;
+};
+
+// Conflict-Based Search: a best-first constraint tree over joint plans, each node replanning one agent
+// with the low level search. Batches of the cheapest nodes are expanded on a pool of threads,
+// a node is only accepted as the solution once it is the cheapest in the tree, so plans stay optimal
+class CbsSolver
+{
+public:
+	explicit CbsSolver(int threadCount);
+	~CbsSolver();
+
+	// Minimizes the sum of costs, fills a path per agent. False when the limits ran out or there is no plan
+	bool Solve(const GridView& grid, const SearchConfig& config, const std::vector<MapfAgent>& agents,
+		const CbsOptions& options, std::vector<std::vector<int> >& paths);
+	const CbsStats& GetStats() const { return mStats; }
+
+private:
+	CbsSolver(const CbsSolver&) = delete;
+	CbsSolver& operator=(const CbsSolver&) = delete;
+
+	// Constraint tree node. Paths are only stored for the agents replanned here, the rest come from the ancestors
+	struct Node
+	{
+		int parent;
+		// Added by this node, agent -1 at the root
+		CbsConstraint constraint;
+		std::vector<int> agents;
+		std::vector<std::vector<int> > paths;
+		int cost;
+		int conflicts;
+	};
+
+	// What a worker produced for one node of the batch
+	struct Expansion
+	{
+		int node;
+		// Paths the node adopted by bypassing, and its conflict count after them
+		std::vector<int> bypassAgents;
+		std::vector<std::vector<int> > bypassPaths;
+		int conflicts;
+		std::vector<Node> children;
+		int bypasses;
+		bool cardinal;
+		long long lowLevelExpanded;
+	};
+
+	// Heap order of mOpen, the cheapest node on top, then the one with fewer conflicts, then the older one
+	struct OpenGreater
+	{
+		explicit OpenGreater(const std::vector<Node>& nodes) : nodes(nodes) {}
+		bool operator()(int a, int b) const
+		{
+			if (nodes[a].cost != nodes[b].cost)
+			{
+				return nodes[a].cost > nodes[b].cost;
+			}
+			if (nodes[a].conflicts != nodes[b].conflicts)
+			{
+				return nodes[a].conflicts > nodes[b].conflicts;
+			}
+			return a > b;
+		}
+		const std::vector<Node>& nodes;
+	};
+
+	void Expand(CbsLowLevel& lowLevel, Expansion& expansion);
+	void GetPaths(int node, std::vector<const std::vector<int>*>& paths) const;
+	void GetConstraints(int node, int agent, std::vector<CbsConstraint>& constraints) const;
+	// Picks the conflict to split on, cardinal ones first when prioritization is on
+	bool ChooseConflict(CbsLowLevel& lowLevel, int node, const std::vector<const std::vector<int>*>& paths, CbsConflict& conflict, bool& cardinal);
+	int CountConflicts(const std::vector<const std::vector<int>*>& paths) const;
+	void PushNode(int node);
+	void WorkerLoop();
+
+	std::vector<std::thread> mWorkers;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+	std::vector<Expansion>* mBatch;
+	size_t mNext;
+	size_t mRemaining;
+	bool mStopping;
+
+	// Instance being solved, read by the workers while a batch runs
+	GridView mGrid;
+	SearchConfig mConfig;
+	CbsOptions mOptions;
+	const std::vector<MapfAgent>* mAgents;
+	std::vector<std::vector<int> > mDistances;
+	std::vector<Node> mNodes;
+	// Binary heap of node indices ordered by OpenGreater
+	std::vector<int> mOpen;
+	CbsLowLevel mRootSearch;
+	CbsStats mStats;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "cbs.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+// Usage: cbs_solver map scen [agents] [threads] [seconds] solves the first 1, 2, ... agents of a MovingAI
+// MAPF benchmark scenario, a line of results per instance, until an instance fails or all agents are in.
+// Moves are four-connected like the benchmark's published results
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s map scen [agents] [threads] [seconds]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<unsigned char> walkable;
+	int columns = 0;
+	int rows = 0;
+	std::vector<MapfAgent> agents;
+	if (!LoadMovingAiMap(argv[1], walkable, columns, rows) || !LoadMovingAiScenario(argv[2], columns, rows, agents))
+	{
+		return 1;
+	}
+	const int maxAgents = argc >= 4 ? std::min(atoi(argv[3]), static_cast<int>(agents.size())) : static_cast<int>(agents.size());
+	const int threads = argc >= 5 ? atoi(argv[4]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	CbsOptions options = MakeDefaultCbsOptions();
+	if (argc >= 6)
+	{
+		options.timeLimitMs = atof(argv[5]) * 1000.0;
+	}
+
+	std::vector<unsigned char> walkableBits;
+	PackWalkableBits(walkable, walkableBits);
+	GridView grid = { columns, rows, &walkableBits[0], nullptr, TERRAIN_GROUND, nullptr, nullptr, nullptr, nullptr, nullptr };
+	SearchConfig config = MakeDefaultSearchConfig();
+	config.connectivity = FOUR_CONNECTED;
+	config.cutCorners = false;
+
+	CbsSolver solver(threads);
+	std::vector<std::vector<int> > paths;
+	printf("%6s %6s %10s %8s %11s %10s %10s %9s %9s %12s %10s\n",
+		"agents", "solved", "cost", "makespan", "lower_bound", "expanded", "generated", "bypasses", "cardinal", "low_level", "ms");
+	for (int count = 1; count <= maxAgents; count++)
+	{
+		std::vector<MapfAgent> instance(agents.begin(), agents.begin() + count);
+		const bool solved = solver.Solve(grid, config, instance, options, paths);
+		const CbsStats& stats = solver.GetStats();
+		printf("%6d %6s %10d %8d %11d %10d %10d %9d %9d %12lld %10.1f\n",
+			count,
+			solved ? "yes" : "no",
+			stats.sumOfCosts,
+			stats.makespan,
+			stats.lowerBound,
+			stats.nodesExpanded,
+			stats.nodesGenerated,
+			stats.bypasses,
+			stats.cardinalSplits,
+			stats.lowLevelExpanded,
+			stats.solveMs);
+		fflush(stdout);
+		if (!solved)
+		{
+			break;
+		}
+	}
+	return 0;
+}
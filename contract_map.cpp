@@ -0,0 +1,69 @@
+#include "contraction.h"
+#include "path_database.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+// Usage: contract_map in out [threads] adds a contraction hierarchy for the default search config to a map
+// file. The grid and any path database are copied out of the input first, so out may be the same file
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s in out [threads]\n", argv[0]);
+		return 1;
+	}
+	const int threads = argc >= 4 ? atoi(argv[3]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+	std::vector<unsigned char> walkableBits;
+	std::vector<unsigned char> terrainCost;
+	std::vector<unsigned char> pathDatabase;
+	GridView grid;
+	{
+		MapFile file;
+		if (!file.Open(argv[1]) || !file.Validate())
+		{
+			return 1;
+		}
+		grid = file.GetGrid();
+		const size_t nodeCount = static_cast<size_t>(grid.columns) * grid.rows;
+		walkableBits.assign(grid.walkableBits, grid.walkableBits + (nodeCount + 7) / 8);
+		grid.walkableBits = &walkableBits[0];
+		if (grid.terrainCost != nullptr)
+		{
+			terrainCost.assign(grid.terrainCost, grid.terrainCost + nodeCount);
+			grid.terrainCost = &terrainCost[0];
+		}
+		uint64_t size = 0;
+		const unsigned char* section = file.GetSection(MAP_SECTION_PATH_DATABASE, &size);
+		if (section != nullptr)
+		{
+			pathDatabase.assign(section, section + size);
+		}
+	}
+
+	ContractionHierarchy hierarchy;
+	if (!hierarchy.Build(grid, MakeDefaultSearchConfig(), threads))
+	{
+		return 1;
+	}
+	std::vector<unsigned char> section;
+	hierarchy.Serialize(section);
+	std::vector<MapSectionData> sections;
+	MapSectionData contraction = { MAP_SECTION_CONTRACTION, &section[0], section.size() };
+	sections.push_back(contraction);
+	if (!pathDatabase.empty())
+	{
+		MapSectionData kept = { MAP_SECTION_PATH_DATABASE, &pathDatabase[0], pathDatabase.size() };
+		sections.push_back(kept);
+	}
+	if (!MapFile::Write(argv[2], grid, sections))
+	{
+		return 1;
+	}
+	const ContractionStats& stats = hierarchy.GetStats();
+	printf("%d nodes, %d shortcuts, %d rounds, %.0f ms on %d threads, %zu byte section\n",
+		stats.nodes, stats.shortcuts, stats.rounds, stats.buildMs, std::max(1, threads), section.size());
+	return 0;
+}
@@ -0,0 +1,602 @@
+#include "contraction.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+struct ContractionShortcut
+{
+	int from;
+	int to;
+	int weight;
+};
+
+// Graph of the nodes not contracted yet, edges to contracted nodes are dropped as they go
+struct ContractionBuilder
+{
+	std::vector<std::vector<ContractionEdge> > out;
+	std::vector<std::vector<ContractionEdge> > in;
+	std::vector<unsigned char> contracted;
+	// Set on the nodes of the current round, witness searches may not pass through them
+	std::vector<unsigned char> contracting;
+	std::vector<int> priority;
+	std::vector<int> contractedNeighbors;
+	// One more than the deepest contracted neighbor, keeps the hierarchy flat
+	std::vector<int> depth;
+
+	// Counts the shortcuts contracting node needs, and collects them when shortcuts is given.
+	// A shortcut u -> w is needed unless the witness search from u finds a path to w no longer than u -> node -> w
+	int FindShortcuts(int node, int settleLimit, SearchSpace<int>& witness, std::vector<ContractionShortcut>* shortcuts) const
+	{
+		int maxOut = 0;
+		for (const ContractionEdge& edge:out[node])
+		{
+			maxOut = std::max(maxOut, static_cast<int>(edge.weight));
+		}
+		OpenEntryGreater<int> greater;
+		int count = 0;
+		for (const ContractionEdge& incoming:in[node])
+		{
+			const int source = incoming.node;
+			const int limit = incoming.weight + maxOut;
+			// The search is over once every neighbor node leads to is settled
+			int targetsLeft = static_cast<int>(out[node].size());
+			witness.Reset();
+			witness.gCost[source] = 0;
+			witness.openedIn[source] = witness.generation;
+			witness.openSet.push_back(OpenEntry<int>{ 0, 0, source });
+			int settled = 0;
+			while (!witness.openSet.empty() && settled < settleLimit && targetsLeft > 0)
+			{
+				std::pop_heap(witness.openSet.begin(), witness.openSet.end(), greater);
+				const OpenEntry<int> entry = witness.openSet.back();
+				witness.openSet.pop_back();
+				if (entry.fCost > limit)
+				{
+					break;
+				}
+				if (witness.closedIn[entry.id] == witness.generation)
+				{
+					continue;
+				}
+				witness.closedIn[entry.id] = witness.generation;
+				settled++;
+				for (const ContractionEdge& outgoing:out[node])
+				{
+					targetsLeft -= outgoing.node == entry.id ? 1 : 0;
+				}
+				for (const ContractionEdge& edge:out[entry.id])
+				{
+					const int next = edge.node;
+					if (next == node || contracting[next])
+					{
+						continue;
+					}
+					const int cost = entry.fCost + edge.weight;
+					if (witness.openedIn[next] != witness.generation || cost < witness.gCost[next])
+					{
+						witness.openedIn[next] = witness.generation;
+						witness.gCost[next] = cost;
+						witness.openSet.push_back(OpenEntry<int>{ cost, cost, next });
+						std::push_heap(witness.openSet.begin(), witness.openSet.end(), greater);
+					}
+				}
+			}
+
+			for (const ContractionEdge& outgoing:out[node])
+			{
+				const int target = outgoing.node;
+				const int weight = incoming.weight + outgoing.weight;
+				if (target == source || (witness.openedIn[target] == witness.generation && witness.gCost[target] <= weight))
+				{
+					continue;
+				}
+				count++;
+				if (shortcuts != nullptr)
+				{
+					shortcuts->push_back(ContractionShortcut{ source, target, weight });
+				}
+			}
+		}
+		return count;
+	}
+
+	// Lower contracts first. Edge difference keeps the graph sparse, the other two spread
+	// the contractions evenly over the map so the hierarchy stays shallow
+	int ComputePriority(int node, SearchSpace<int>& witness) const
+	{
+		const int removed = static_cast<int>(in[node].size() + out[node].size());
+		const int added = FindShortcuts(node, GLOBAL_CONST_PRIORITY_SETTLE_LIMIT, witness, nullptr);
+		return 2 * (added - removed) + contractedNeighbors[node] + 2 * depth[node];
+	}
+
+	bool IsLocalMinimum(int node) const
+	{
+		for (int direction = 0; direction < 2; direction++)
+		{
+			for (const ContractionEdge& edge:direction == 0 ? out[node] : in[node])
+			{
+				const int neighbor = edge.node;
+				if (priority[neighbor] < priority[node] || (priority[neighbor] == priority[node] && neighbor < node))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Keeps one edge per ordered pair, the cheaper one
+	static void AddEdge(std::vector<ContractionEdge>& edges, int node, int weight, int middle)
+	{
+		for (ContractionEdge& edge:edges)
+		{
+			if (edge.node == node)
+			{
+				if (weight < edge.weight)
+				{
+					edge.weight = weight;
+					edge.middle = middle;
+				}
+				return;
+			}
+		}
+		edges.push_back(ContractionEdge{ node, weight, middle });
+	}
+
+	static void RemoveEdge(std::vector<ContractionEdge>& edges, int node)
+	{
+		for (size_t i = 0; i < edges.size(); i++)
+		{
+			if (edges[i].node == node)
+			{
+				edges[i] = edges.back();
+				edges.pop_back();
+				return;
+			}
+		}
+	}
+};
+
+ContractionHierarchy::ContractionHierarchy()
+{
+	std::memset(&mHeader, 0, sizeof(mHeader));
+	mRank = nullptr;
+	mFirstForward = nullptr;
+	mFirstBackward = nullptr;
+	mForward = nullptr;
+	mBackward = nullptr;
+	mStats = ContractionStats();
+}
+
+bool ContractionHierarchy::Build(const GridView& grid, const SearchConfig& config, int threadCount)
+{
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	mStats = ContractionStats();
+	threadCount = std::max(1, threadCount);
+	const int nodeCount = grid.columns * grid.rows;
+
+	// Grid steps cost what PathSearch charges for them, the base step times the terrain entered
+	ContractionBuilder builder;
+	builder.out.resize(nodeCount);
+	builder.in.resize(nodeCount);
+	builder.contracted.assign(nodeCount, 0);
+	builder.contracting.assign(nodeCount, 0);
+	builder.priority.assign(nodeCount, 0);
+	builder.contractedNeighbors.assign(nodeCount, 0);
+	builder.depth.assign(nodeCount, 0);
+	std::vector<int> remaining;
+	for (int id = 0; id < nodeCount; id++)
+	{
+		const int x = id / grid.rows;
+		const int y = id % grid.rows;
+		if (!grid.IsWalkable(x, y))
+		{
+			continue;
+		}
+		remaining.push_back(id);
+		for (int i = 0; i < config.connectivity; i++)
+		{
+			if (!grid.CanStep(x, y, x + offsetX[i], y + offsetY[i], config.cutCorners))
+			{
+				continue;
+			}
+			const int neighbor = grid.GetCellId(x + offsetX[i], y + offsetY[i]);
+			const int step = i >= 4 ? CostTraits<int>::Diagonal() : CostTraits<int>::Straight();
+			const int weight = step * grid.GetTerrainCost(neighbor);
+			builder.out[id].push_back(ContractionEdge{ neighbor, weight, -1 });
+			builder.in[neighbor].push_back(ContractionEdge{ id, weight, -1 });
+		}
+	}
+	if (remaining.empty())
+	{
+		PathfindingLog("A contraction hierarchy needs at least one walkable node");
+		return false;
+	}
+
+	std::vector<SearchSpace<int> > witnesses(threadCount);
+	for (SearchSpace<int>& witness:witnesses)
+	{
+		witness.Resize(nodeCount);
+	}
+	ParallelFor(static_cast<int>(remaining.size()), threadCount, [&](int i, int worker) {
+		builder.priority[remaining[i]] = builder.ComputePriority(remaining[i], witnesses[worker]);
+	});
+
+	// Upward edges of each node, frozen as it is contracted
+	std::vector<std::vector<ContractionEdge> > forward(nodeCount);
+	std::vector<std::vector<ContractionEdge> > backward(nodeCount);
+	mOwnedRank.assign(nodeCount, GLOBAL_CONST_CONTRACTION_NO_RANK);
+	uint32_t nextRank = 0;
+	std::vector<int> round;
+	std::vector<std::vector<ContractionShortcut> > shortcuts;
+	std::vector<int> affected;
+	std::vector<unsigned char> isAffected(nodeCount, 0);
+	while (!remaining.empty())
+	{
+		round.clear();
+		for (int node:remaining)
+		{
+			if (builder.IsLocalMinimum(node))
+			{
+				round.push_back(node);
+				builder.contracting[node] = 1;
+			}
+		}
+
+		shortcuts.resize(round.size());
+		ParallelFor(static_cast<int>(round.size()), threadCount, [&](int i, int worker) {
+			shortcuts[i].clear();
+			builder.FindShortcuts(round[i], GLOBAL_CONST_WITNESS_SETTLE_LIMIT, witnesses[worker], &shortcuts[i]);
+		});
+
+		affected.clear();
+		for (size_t i = 0; i < round.size(); i++)
+		{
+			const int node = round[i];
+			mOwnedRank[node] = nextRank++;
+			forward[node] = builder.out[node];
+			backward[node] = builder.in[node];
+			for (int direction = 0; direction < 2; direction++)
+			{
+				for (const ContractionEdge& edge:direction == 0 ? builder.out[node] : builder.in[node])
+				{
+					const int neighbor = edge.node;
+					ContractionBuilder::RemoveEdge(direction == 0 ? builder.in[neighbor] : builder.out[neighbor], node);
+					builder.contractedNeighbors[neighbor]++;
+					builder.depth[neighbor] = std::max(builder.depth[neighbor], builder.depth[node] + 1);
+					if (!isAffected[neighbor])
+					{
+						isAffected[neighbor] = 1;
+						affected.push_back(neighbor);
+					}
+				}
+			}
+			for (const ContractionShortcut& shortcut:shortcuts[i])
+			{
+				ContractionBuilder::AddEdge(builder.out[shortcut.from], shortcut.to, shortcut.weight, node);
+				ContractionBuilder::AddEdge(builder.in[shortcut.to], shortcut.from, shortcut.weight, node);
+			}
+			mStats.shortcuts += static_cast<int>(shortcuts[i].size());
+			std::vector<ContractionEdge>().swap(builder.out[node]);
+			std::vector<ContractionEdge>().swap(builder.in[node]);
+			builder.contracted[node] = 1;
+			builder.contracting[node] = 0;
+		}
+
+		remaining.erase(std::remove_if(remaining.begin(), remaining.end(), [&](int node) { return builder.contracted[node] != 0; }), remaining.end());
+		affected.erase(std::remove_if(affected.begin(), affected.end(), [&](int node) { return builder.contracted[node] != 0; }), affected.end());
+		ParallelFor(static_cast<int>(affected.size()), threadCount, [&](int i, int worker) {
+			builder.priority[affected[i]] = builder.ComputePriority(affected[i], witnesses[worker]);
+		});
+		for (int node:affected)
+		{
+			isAffected[node] = 0;
+		}
+		mStats.rounds++;
+	}
+
+	mHeader.columns = static_cast<uint32_t>(grid.columns);
+	mHeader.rows = static_cast<uint32_t>(grid.rows);
+	mHeader.connectivity = static_cast<uint32_t>(config.connectivity);
+	mHeader.cutCorners = config.cutCorners ? 1 : 0;
+	mOwnedFirstForward.assign(nodeCount + 1, 0);
+	mOwnedFirstBackward.assign(nodeCount + 1, 0);
+	mOwnedForward.clear();
+	mOwnedBackward.clear();
+	for (int id = 0; id < nodeCount; id++)
+	{
+		mOwnedFirstForward[id] = static_cast<uint32_t>(mOwnedForward.size());
+		mOwnedFirstBackward[id] = static_cast<uint32_t>(mOwnedBackward.size());
+		mOwnedForward.insert(mOwnedForward.end(), forward[id].begin(), forward[id].end());
+		mOwnedBackward.insert(mOwnedBackward.end(), backward[id].begin(), backward[id].end());
+	}
+	mOwnedFirstForward[nodeCount] = static_cast<uint32_t>(mOwnedForward.size());
+	mOwnedFirstBackward[nodeCount] = static_cast<uint32_t>(mOwnedBackward.size());
+	mHeader.forwardEdgeCount = static_cast<uint32_t>(mOwnedForward.size());
+	mHeader.backwardEdgeCount = static_cast<uint32_t>(mOwnedBackward.size());
+	PointAtOwnedData();
+
+	mStats.nodes = static_cast<int>(nextRank);
+	mStats.buildMs = GetElapsedMs(begin);
+	return true;
+}
+
+void ContractionHierarchy::PointAtOwnedData()
+{
+	mRank = &mOwnedRank[0];
+	mFirstForward = &mOwnedFirstForward[0];
+	mFirstBackward = &mOwnedFirstBackward[0];
+	mForward = mOwnedForward.empty() ? nullptr : &mOwnedForward[0];
+	mBackward = mOwnedBackward.empty() ? nullptr : &mOwnedBackward[0];
+}
+
+static void AppendBytes(std::vector<unsigned char>& bytes, const void* data, size_t size)
+{
+	const unsigned char* begin = static_cast<const unsigned char*>(data);
+	bytes.insert(bytes.end(), begin, begin + size);
+}
+
+void ContractionHierarchy::Serialize(std::vector<unsigned char>& bytes) const
+{
+	const size_t nodeCount = static_cast<size_t>(mHeader.columns) * mHeader.rows;
+	AppendBytes(bytes, &mHeader, sizeof(mHeader));
+	AppendBytes(bytes, mRank, nodeCount * sizeof(uint32_t));
+	AppendBytes(bytes, mFirstForward, (nodeCount + 1) * sizeof(uint32_t));
+	AppendBytes(bytes, mFirstBackward, (nodeCount + 1) * sizeof(uint32_t));
+	AppendBytes(bytes, mForward, mHeader.forwardEdgeCount * sizeof(ContractionEdge));
+	AppendBytes(bytes, mBackward, mHeader.backwardEdgeCount * sizeof(ContractionEdge));
+}
+
+// Offsets that never decrease and end at the edge count, edges that lead to a higher ranked node and
+// shortcuts whose middle ranks below both ends, which is what keeps the searches and UnpackEdge in bounds
+static bool AreEdgesValid(const uint32_t* rank, uint64_t nodeCount, const uint32_t* first, const ContractionEdge* edges, uint32_t edgeCount)
+{
+	if (first[nodeCount] != edgeCount)
+	{
+		return false;
+	}
+	for (uint64_t owner = 0; owner < nodeCount; owner++)
+	{
+		if (first[owner] > first[owner + 1])
+		{
+			return false;
+		}
+		for (uint32_t i = first[owner]; i < first[owner + 1]; i++)
+		{
+			const ContractionEdge& edge = edges[i];
+			if (edge.node < 0 || static_cast<uint64_t>(edge.node) >= nodeCount || edge.weight < 0 ||
+				rank[edge.node] == GLOBAL_CONST_CONTRACTION_NO_RANK || rank[edge.node] <= rank[owner])
+			{
+				return false;
+			}
+			if (edge.middle >= 0 && (static_cast<uint64_t>(edge.middle) >= nodeCount || rank[edge.middle] >= rank[owner]))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool ContractionHierarchy::Attach(const unsigned char* data, uint64_t size)
+{
+	if (data == nullptr || size < sizeof(ContractionSectionHeader))
+	{
+		PathfindingLog("Contraction hierarchy section is missing or truncated");
+		return false;
+	}
+	ContractionSectionHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	const uint64_t nodeCount = static_cast<uint64_t>(header.columns) * header.rows;
+	const uint64_t expected = sizeof(header) + (3 * nodeCount + 2) * sizeof(uint32_t) +
+		(static_cast<uint64_t>(header.forwardEdgeCount) + header.backwardEdgeCount) * sizeof(ContractionEdge);
+	// Node ids are ints
+	if (size != expected || nodeCount > static_cast<uint64_t>(std::numeric_limits<int>::max()) ||
+		(header.connectivity != FOUR_CONNECTED && header.connectivity != EIGHT_CONNECTED))
+	{
+		PathfindingLog("Contraction hierarchy section has %llu bytes, expected %llu", static_cast<unsigned long long>(size), static_cast<unsigned long long>(expected));
+		return false;
+	}
+
+	mHeader = header;
+	const unsigned char* position = data + sizeof(header);
+	mRank = reinterpret_cast<const uint32_t*>(position);
+	position += nodeCount * sizeof(uint32_t);
+	mFirstForward = reinterpret_cast<const uint32_t*>(position);
+	position += (nodeCount + 1) * sizeof(uint32_t);
+	mFirstBackward = reinterpret_cast<const uint32_t*>(position);
+	position += (nodeCount + 1) * sizeof(uint32_t);
+	mForward = reinterpret_cast<const ContractionEdge*>(position);
+	position += header.forwardEdgeCount * sizeof(ContractionEdge);
+	mBackward = reinterpret_cast<const ContractionEdge*>(position);
+
+	// The section is used in place, so everything the queries index with is checked once here
+	bool valid = true;
+	for (uint64_t node = 0; node < nodeCount && valid; node++)
+	{
+		valid = mRank[node] < nodeCount || mRank[node] == GLOBAL_CONST_CONTRACTION_NO_RANK;
+	}
+	valid = valid && AreEdgesValid(mRank, nodeCount, mFirstForward, mForward, header.forwardEdgeCount) &&
+		AreEdgesValid(mRank, nodeCount, mFirstBackward, mBackward, header.backwardEdgeCount);
+	if (!valid)
+	{
+		PathfindingLog("Contraction hierarchy section has out of range ranks, edges or edge offsets");
+		mRank = nullptr;
+		return false;
+	}
+	mStats = ContractionStats();
+	mStats.nodes = static_cast<int>(nodeCount);
+	return true;
+}
+
+bool ContractionHierarchy::Matches(const GridView& grid, const SearchConfig& config) const
+{
+	return mRank != nullptr &&
+		mHeader.columns == static_cast<uint32_t>(grid.columns) &&
+		mHeader.rows == static_cast<uint32_t>(grid.rows) &&
+		mHeader.connectivity == static_cast<uint32_t>(config.connectivity) &&
+		(mHeader.cutCorners != 0) == config.cutCorners &&
+		config.mode == PATH_GRID &&
+		config.cost == COST_INT &&
+		config.agentSize == 1;
+}
+
+// Nodes are only settled from below, a node some higher node reaches more cheaply is stalled:
+// its distance is not the shortest one, so nothing is relaxed from it
+bool ContractionHierarchy::SettleNext(SearchSpace<int>& space, const SearchSpace<int>& other, bool forward, int& best, int& meeting) const
+{
+	OpenEntryGreater<int> greater;
+	while (!space.openSet.empty())
+	{
+		if (space.openSet.front().fCost >= best)
+		{
+			space.openSet.clear();
+			return false;
+		}
+		std::pop_heap(space.openSet.begin(), space.openSet.end(), greater);
+		const OpenEntry<int> entry = space.openSet.back();
+		space.openSet.pop_back();
+		const int node = entry.id;
+		if (space.closedIn[node] == space.generation)
+		{
+			continue;
+		}
+		space.closedIn[node] = space.generation;
+
+		if (other.openedIn[node] == other.generation && entry.fCost + other.gCost[node] < best)
+		{
+			best = entry.fCost + other.gCost[node];
+			meeting = node;
+		}
+
+		// Searching up from the start follows forward edges, down from the target backward ones
+		const uint32_t* first = forward ? mFirstForward : mFirstBackward;
+		const ContractionEdge* edges = forward ? mForward : mBackward;
+		const uint32_t* stallFirst = forward ? mFirstBackward : mFirstForward;
+		const ContractionEdge* stallEdges = forward ? mBackward : mForward;
+		bool stalled = false;
+		for (uint32_t i = stallFirst[node]; i < stallFirst[node + 1] && !stalled; i++)
+		{
+			const int higher = stallEdges[i].node;
+			stalled = space.openedIn[higher] == space.generation && space.gCost[higher] + stallEdges[i].weight < entry.fCost;
+		}
+		if (stalled)
+		{
+			return true;
+		}
+
+		for (uint32_t i = first[node]; i < first[node + 1]; i++)
+		{
+			const int next = edges[i].node;
+			const int cost = entry.fCost + edges[i].weight;
+			if (space.openedIn[next] != space.generation || cost < space.gCost[next])
+			{
+				space.openedIn[next] = space.generation;
+				space.gCost[next] = cost;
+				space.parent[next] = node;
+				space.openSet.push_back(OpenEntry<int>{ cost, cost, next });
+				std::push_heap(space.openSet.begin(), space.openSet.end(), greater);
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+bool ContractionHierarchy::FindPath(int start, int target, SearchSpace<int>& forward, SearchSpace<int>& backward,
+	std::vector<int>& path, int& settled) const
+{
+	path.clear();
+	settled = 0;
+	if (!Contains(start) || !Contains(target))
+	{
+		return false;
+	}
+	const int nodeCount = static_cast<int>(mHeader.columns * mHeader.rows);
+	forward.Resize(nodeCount);
+	backward.Resize(nodeCount);
+	forward.Reset();
+	backward.Reset();
+	forward.gCost[start] = 0;
+	forward.parent[start] = start;
+	forward.openedIn[start] = forward.generation;
+	forward.openSet.push_back(OpenEntry<int>{ 0, 0, start });
+	backward.gCost[target] = 0;
+	backward.parent[target] = target;
+	backward.openedIn[target] = backward.generation;
+	backward.openSet.push_back(OpenEntry<int>{ 0, 0, target });
+
+	int best = std::numeric_limits<int>::max();
+	int meeting = -1;
+	bool forwardOpen = true;
+	bool backwardOpen = true;
+	while (forwardOpen || backwardOpen)
+	{
+		if (forwardOpen)
+		{
+			forwardOpen = SettleNext(forward, backward, true, best, meeting);
+			settled += forwardOpen ? 1 : 0;
+		}
+		if (backwardOpen)
+		{
+			backwardOpen = SettleNext(backward, forward, false, best, meeting);
+			settled += backwardOpen ? 1 : 0;
+		}
+	}
+	if (meeting < 0)
+	{
+		return false;
+	}
+
+	// Hierarchy nodes up from the start to the meeting node, then down to the target
+	for (int node = meeting; node != start; node = forward.parent[node])
+	{
+		path.push_back(node);
+	}
+	path.push_back(start);
+	std::reverse(path.begin(), path.end());
+	for (int node = meeting; node != target; node = backward.parent[node])
+	{
+		path.push_back(backward.parent[node]);
+	}
+
+	// The grid path is unpacked after them and they are dropped at the end, so no other buffer is needed
+	const size_t packedCount = path.size();
+	path.push_back(path[0]);
+	for (size_t i = 1; i < packedCount; i++)
+	{
+		UnpackEdge(path[i - 1], path[i], path);
+	}
+	path.erase(path.begin(), path.begin() + packedCount);
+	return true;
+}
+
+const ContractionEdge* ContractionHierarchy::FindEdge(const uint32_t* first, const ContractionEdge* edges, int owner, int node) const
+{
+	for (uint32_t i = first[owner]; i < first[owner + 1]; i++)
+	{
+		if (edges[i].node == node)
+		{
+			return &edges[i];
+		}
+	}
+	return nullptr;
+}
+
+// An edge is stored with its lower end, as a forward edge when that is where it starts
+void ContractionHierarchy::UnpackEdge(int from, int to, std::vector<int>& path) const
+{
+	const ContractionEdge* edge = mRank[from] < mRank[to] ?
+		FindEdge(mFirstForward, mForward, from, to) : FindEdge(mFirstBackward, mBackward, to, from);
+	if (edge == nullptr || edge->middle < 0)
+	{
+		path.push_back(to);
+		return;
+	}
+	UnpackEdge(from, edge->middle, path);
+	UnpackEdge(edge->middle, to, path);
+}
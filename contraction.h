@@ -0,0 +1,105 @@
+// Contraction hierarchies over the grid graph, for maps that change rarely
+#ifndef CONTRACTION_H
+#define CONTRACTION_H
+
+#include "pathfinding.h"
+
+#include <vector>
+
+// Nodes the witness search of one contraction may settle. Past it the search gives up and adds the
+// shortcut anyway, which only costs a redundant edge
+const int GLOBAL_CONST_WITNESS_SETTLE_LIMIT = 256;
+// Same limit while only estimating the shortcuts of a node for its priority. Priorities are recomputed
+// every time a neighbor is contracted, a tight limit keeps that to a fraction of the build for a few more shortcuts
+const int GLOBAL_CONST_PRIORITY_SETTLE_LIMIT = 16;
+// Rank of a wall in the section
+const uint32_t GLOBAL_CONST_CONTRACTION_NO_RANK = 0xffffffff;
+
+// Edge of the hierarchy, middle is the node a shortcut bypasses or -1 for a step between grid neighbors
+struct ContractionEdge
+{
+	int32_t node;
+	int32_t weight;
+	int32_t middle;
+};
+
+// Start of the map file section, followed by the rank of every node, the forward and backward
+// edge offsets, each nodeCount + 1 long, then the forward and backward edges
+struct ContractionSectionHeader
+{
+	uint32_t columns;
+	uint32_t rows;
+	uint32_t connectivity;
+	uint32_t cutCorners;
+	uint32_t forwardEdgeCount;
+	uint32_t backwardEdgeCount;
+};
+
+// Counters of the last Build
+struct ContractionStats
+{
+	int nodes;
+	int shortcuts;
+	int rounds;
+	double buildMs;
+};
+
+// Every walkable node gets a rank, contracting it removes it from the graph and adds a shortcut for each
+// shortest path through it. Nodes only keep edges to higher ranks: forward edges leave a node upwards,
+// backward edges arrive at it from above. A query searches upwards from both ends and meets at the top,
+// so it settles a few hundred nodes whatever the distance. Costs are the int costs of PathSearch for
+// the connectivity and corner rule the hierarchy was built with, with agents of one node
+class ContractionHierarchy
+{
+public:
+	ContractionHierarchy();
+
+	// Orders and contracts the walkable nodes on threadCount threads. Each round contracts the nodes
+	// whose priority (shortcuts added minus edges removed, contracted neighbors and depth) is lowest
+	// among their neighbors, in parallel since no two of them are adjacent
+	bool Build(const GridView& grid, const SearchConfig& config, int threadCount);
+	// Appends the map file section
+	void Serialize(std::vector<unsigned char>& bytes) const;
+	// Uses a section in place, usually from a mapped map file, which has to outlive the hierarchy
+	bool Attach(const unsigned char* data, uint64_t size);
+
+	bool IsEmpty() const { return mRank == nullptr; }
+	// True when the hierarchy answers queries of that config on that grid exactly
+	bool Matches(const GridView& grid, const SearchConfig& config) const;
+	// Walls are left out of the hierarchy, A* still answers queries starting or ending on one
+	bool Contains(int node) const { return mRank[node] != GLOBAL_CONST_CONTRACTION_NO_RANK; }
+	// Fills path with every node from start to target, settled counts the nodes both searches took.
+	// The hierarchy is only read, threads share it with search spaces of their own
+	bool FindPath(int start, int target, SearchSpace<int>& forward, SearchSpace<int>& backward,
+		std::vector<int>& path, int& settled) const;
+	const ContractionStats& GetStats() const { return mStats; }
+
+private:
+	ContractionHierarchy(const ContractionHierarchy&) = delete;
+	ContractionHierarchy& operator=(const ContractionHierarchy&) = delete;
+
+	// Settles the lowest open node of one direction, returns false once that direction is done
+	bool SettleNext(SearchSpace<int>& space, const SearchSpace<int>& other, bool forward, int& best, int& meeting) const;
+	// Appends the grid nodes the edge from one node to another stands for, except from itself.
+	// Shortcuts nest about as deep as the hierarchy has levels, so the recursion stays shallow
+	void UnpackEdge(int from, int to, std::vector<int>& path) const;
+	const ContractionEdge* FindEdge(const uint32_t* first, const ContractionEdge* edges, int owner, int node) const;
+	void PointAtOwnedData();
+
+	ContractionSectionHeader mHeader;
+	// Point into the owned vectors after Build, into the section after Attach. Walls have GLOBAL_CONST_CONTRACTION_NO_RANK
+	const uint32_t* mRank;
+	const uint32_t* mFirstForward;
+	const uint32_t* mFirstBackward;
+	const ContractionEdge* mForward;
+	const ContractionEdge* mBackward;
+
+	std::vector<uint32_t> mOwnedRank;
+	std::vector<uint32_t> mOwnedFirstForward;
+	std::vector<uint32_t> mOwnedFirstBackward;
+	std::vector<ContractionEdge> mOwnedForward;
+	std::vector<ContractionEdge> mOwnedBackward;
+	ContractionStats mStats;
+};
+
+#endif
@@ -0,0 +1,447 @@
+#include "cooperative_search.h"
+
+#include <algorithm>
+
+// Times an agent may be replanned within one Step, bumps and displaced reservations can chain
+const int GLOBAL_CONST_COOPERATIVE_MAX_REPLANS_PER_STEP = 4;
+
+ReservationTable::ReservationTable()
+{
+	mMask = 0;
+	mNow = 0;
+	Reset(0, 0);
+}
+
+// The ring holds window + 1 ticks, rounded up to a power of two so the bucket index is a mask
+void ReservationTable::Reset(int now, int window)
+{
+	size_t capacity = 1;
+	while (capacity < static_cast<size_t>(window) + 1)
+	{
+		capacity <<= 1;
+	}
+	mBuckets.assign(capacity, std::unordered_map<int, int>());
+	mMask = capacity - 1;
+	mNow = now;
+}
+
+void ReservationTable::Advance(int now)
+{
+	while (mNow < now)
+	{
+		mBuckets[mNow & mMask].clear();
+		mNow++;
+	}
+}
+
+int ReservationTable::Reserve(int cell, int time, int agent)
+{
+	if (time < mNow || time > mNow + static_cast<int>(mMask))
+	{
+		PathfindingLog("Reservation at tick %d is outside the window starting at %d", time, mNow);
+		return GLOBAL_CONST_NO_AGENT;
+	}
+	std::unordered_map<int, int>& bucket = mBuckets[time & mMask];
+	std::unordered_map<int, int>::iterator reservation = bucket.find(cell);
+	if (reservation == bucket.end())
+	{
+		bucket[cell] = agent;
+		return GLOBAL_CONST_NO_AGENT;
+	}
+	const int holder = reservation->second;
+	reservation->second = agent;
+	return holder;
+}
+
+void ReservationTable::Release(int cell, int time, int agent)
+{
+	if (time < mNow || time > mNow + static_cast<int>(mMask))
+	{
+		return;
+	}
+	std::unordered_map<int, int>& bucket = mBuckets[time & mMask];
+	std::unordered_map<int, int>::iterator reservation = bucket.find(cell);
+	if (reservation != bucket.end() && reservation->second == agent)
+	{
+		bucket.erase(reservation);
+	}
+}
+
+int ReservationTable::GetHolder(int cell, int time) const
+{
+	if (time < mNow || time > mNow + static_cast<int>(mMask))
+	{
+		return GLOBAL_CONST_NO_AGENT;
+	}
+	const std::unordered_map<int, int>& bucket = mBuckets[time & mMask];
+	std::unordered_map<int, int>::const_iterator reservation = bucket.find(cell);
+	return reservation != bucket.end() ? reservation->second : GLOBAL_CONST_NO_AGENT;
+}
+
+size_t ReservationTable::GetReservationCount() const
+{
+	size_t count = 0;
+	for (const std::unordered_map<int, int>& bucket:mBuckets)
+	{
+		count += bucket.size();
+	}
+	return count;
+}
+
+CooperativePlanner::CooperativePlanner()
+{
+	mGrid = GridView();
+	mConfig = MakeDefaultSearchConfig();
+	mReplanInterval = GLOBAL_CONST_COOPERATIVE_WINDOW / 2;
+	mNow = 0;
+	mStats = CooperativeStats();
+}
+
+void CooperativePlanner::SetGrid(const GridView& grid, const SearchConfig& config)
+{
+	mGrid = grid;
+	mConfig = config;
+	mNow = 0;
+	mAgents.clear();
+	mDistances.clear();
+	mReservations.Reset(mNow, GLOBAL_CONST_COOPERATIVE_WINDOW);
+	const int side = 2 * GLOBAL_CONST_COOPERATIVE_WINDOW + 1;
+	mSearch.Resize((GLOBAL_CONST_COOPERATIVE_WINDOW + 1) * side * side);
+}
+
+// Longer intervals spread the replans thinner, but an agent has to replan before its plan runs out
+void CooperativePlanner::SetReplanInterval(int interval)
+{
+	mReplanInterval = std::max(1, std::min(interval, GLOBAL_CONST_COOPERATIVE_WINDOW));
+}
+
+int CooperativePlanner::AddAgent(int start, int goal)
+{
+	Agent agent;
+	agent.goal = goal;
+	agent.plan.push_back(start);
+	agent.nextReplan = mNow;
+	agent.resting = false;
+	mAgents.push_back(agent);
+	AcquireDistances(goal);
+	return static_cast<int>(mAgents.size()) - 1;
+}
+
+void CooperativePlanner::SetGoal(int agent, int goal)
+{
+	Agent& current = mAgents[agent];
+	if (current.goal == goal)
+	{
+		return;
+	}
+	AcquireDistances(goal);
+	ReleaseDistances(current.goal);
+	current.goal = goal;
+	current.nextReplan = mNow;
+	current.resting = false;
+}
+
+void CooperativePlanner::Step()
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	mStats = CooperativeStats();
+
+	// Starting the scan at a different agent every tick rotates who reserves first
+	const int agentCount = GetAgentCount();
+	mBumpQueue.clear();
+	for (int i = 0; i < agentCount; i++)
+	{
+		const int agent = (mNow + i) % agentCount;
+		if (mAgents[agent].nextReplan <= mNow)
+		{
+			mBumpQueue.push_back(agent);
+		}
+	}
+
+	// Replans can queue more agents, the ones they bumped or pushed out of their reservations
+	mReplanCount.assign(agentCount, 0);
+	for (size_t i = 0; i < mBumpQueue.size(); i++)
+	{
+		const int agent = mBumpQueue[i];
+		if (mReplanCount[agent]++ < GLOBAL_CONST_COOPERATIVE_MAX_REPLANS_PER_STEP)
+		{
+			Replan(agent);
+		}
+	}
+
+	for (Agent& agent:mAgents)
+	{
+		if (agent.plan.size() > 1)
+		{
+			agent.plan.erase(agent.plan.begin());
+		}
+	}
+	mNow++;
+	mReservations.Advance(mNow);
+	mStats.stepMs = GetElapsedMs(begin);
+}
+
+void CooperativePlanner::Replan(int agent)
+{
+	mStats.replans++;
+	ReleasePlan(agent);
+
+	Agent& current = mAgents[agent];
+	std::vector<int>& path = mWindowPath;
+	const bool found = FindWindowPath(agent, path);
+	if (found)
+	{
+		current.resting = std::count(path.begin(), path.end(), current.goal) == static_cast<int>(path.size());
+	}
+	else
+	{
+		// Nowhere to go, so hold the cell. Whoever planned through it is pushed out and replans
+		mStats.failures++;
+		path.assign(GLOBAL_CONST_COOPERATIVE_WINDOW + 1, current.plan[0]);
+		current.resting = false;
+	}
+
+	// The first plan of an agent staggers it against the agents added along with it
+	current.nextReplan = mNow + (current.plan.size() == 1 ? 1 + agent % mReplanInterval : mReplanInterval);
+	// The old plan becomes the scratch buffer of the next replan
+	current.plan.swap(path);
+
+	mDisplaced.clear();
+	ReservePlan(agent, mDisplaced);
+	for (int other:mDisplaced)
+	{
+		mStats.bumps += mAgents[other].resting;
+		mBumpQueue.push_back(other);
+	}
+}
+
+// A resting agent gives up its cell to another agent from the tick after next on, which
+// leaves it the next tick to step aside. Agents sharing a goal never bump each other
+bool CooperativePlanner::IsFree(int agent, int from, int to, int time) const
+{
+	const int holder = mReservations.GetHolder(to, time);
+	if (holder != GLOBAL_CONST_NO_AGENT && holder != agent)
+	{
+		const Agent& other = mAgents[holder];
+		if (!other.resting || other.goal == mAgents[agent].goal || time < mNow + 2)
+		{
+			return false;
+		}
+	}
+
+	// Two agents swapping cells during the same tick
+	if (from != to)
+	{
+		const int swapper = mReservations.GetHolder(from, time);
+		if (swapper != GLOBAL_CONST_NO_AGENT && swapper != agent && mReservations.GetHolder(to, time - 1) == swapper)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CooperativePlanner::FindWindowPath(int agent, std::vector<int>& path)
+{
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+	const int window = GLOBAL_CONST_COOPERATIVE_WINDOW;
+	const int side = 2 * window + 1;
+	const int area = side * side;
+
+	const Agent& current = mAgents[agent];
+	const int start = current.plan[0];
+	const int goal = current.goal;
+	const int startX = start / mGrid.rows;
+	const int startY = start % mGrid.rows;
+	const std::vector<int>& distance = mDistances[goal].distance;
+	// With the goal out of reach the agent only looks for somewhere to wait
+	const bool reachable = distance[start] != CostTraits<int>::Infinity();
+
+	SearchSpace<int>& space = mSearch;
+	space.Reset();
+	OpenEntryGreater<int> greater;
+
+	const int startState = window * side + window;
+	space.gCost[startState] = 0;
+	space.parent[startState] = startState;
+	space.openedIn[startState] = space.generation;
+	const int startH = reachable ? distance[start] : 0;
+	OpenEntry<int> startEntry = { startH, startH, startState };
+	space.openSet.push_back(startEntry);
+
+	while (space.openSet.size() > 0)
+	{
+		std::pop_heap(space.openSet.begin(), space.openSet.end(), greater);
+		const int state = space.openSet.back().id;
+		space.openSet.pop_back();
+		if (space.closedIn[state] == space.generation)
+		{
+			continue;
+		}
+		space.closedIn[state] = space.generation;
+		mStats.statesExpanded++;
+
+		const int tick = state / area;
+		const int x = startX + (state % area) / side - window;
+		const int y = startY + state % side - window;
+		const int cell = mGrid.GetCellId(x, y);
+
+		// Done at the end of the window, or earlier on a goal nobody needs until then
+		bool done = tick == window;
+		if (!done && cell == goal)
+		{
+			done = true;
+			for (int t = tick + 1; done && t <= window; t++)
+			{
+				done = IsFree(agent, goal, goal, mNow + t);
+			}
+		}
+		if (done)
+		{
+			path.assign(window + 1, cell);
+			for (int walk = state; walk != startState; walk = space.parent[walk])
+			{
+				path[walk / area] = mGrid.GetCellId(startX + (walk % area) / side - window, startY + walk % side - window);
+			}
+			path[0] = start;
+			return true;
+		}
+
+		// Waiting in place first, then the moves
+		for (int i = -1; i < mConfig.connectivity; i++)
+		{
+			const int neighborX = i < 0 ? x : x + offsetX[i];
+			const int neighborY = i < 0 ? y : y + offsetY[i];
+			if (i >= 0 && !mGrid.CanStep(x, y, neighborX, neighborY, mConfig.cutCorners))
+			{
+				continue;
+			}
+			const int neighbor = mGrid.GetCellId(neighborX, neighborY);
+			if (!IsFree(agent, cell, neighbor, mNow + tick + 1))
+			{
+				continue;
+			}
+			const int neighborState = state + area + (neighborX - x) * side + (neighborY - y);
+			if (space.closedIn[neighborState] == space.generation)
+			{
+				continue;
+			}
+
+			// Waiting on the goal is free, waiting anywhere else costs like a straight step
+			int step;
+			if (i < 0)
+			{
+				step = cell == goal ? 0 : CostTraits<int>::Straight() * mGrid.GetTerrainCost(cell);
+			}
+			else
+			{
+				step = (i >= 4 ? CostTraits<int>::Diagonal() : CostTraits<int>::Straight()) * mGrid.GetTerrainCost(neighbor);
+			}
+			const int cost = space.gCost[state] + step;
+			if (space.openedIn[neighborState] != space.generation || cost < space.gCost[neighborState])
+			{
+				space.openedIn[neighborState] = space.generation;
+				space.gCost[neighborState] = cost;
+				space.parent[neighborState] = state;
+				const int h = reachable ? distance[neighbor] : 0;
+				OpenEntry<int> entry = { cost + h, h, neighborState };
+				space.openSet.push_back(entry);
+				std::push_heap(space.openSet.begin(), space.openSet.end(), greater);
+			}
+		}
+	}
+	return false;
+}
+
+// Claims a cell per tick of the plan, the agents that held any of them are returned
+void CooperativePlanner::ReservePlan(int agent, std::vector<int>& displaced)
+{
+	const std::vector<int>& plan = mAgents[agent].plan;
+	for (size_t i = 0; i < plan.size(); i++)
+	{
+		const int holder = mReservations.Reserve(plan[i], mNow + static_cast<int>(i), agent);
+		if (holder != GLOBAL_CONST_NO_AGENT && holder != agent &&
+			std::find(displaced.begin(), displaced.end(), holder) == displaced.end())
+		{
+			displaced.push_back(holder);
+		}
+	}
+}
+
+void CooperativePlanner::ReleasePlan(int agent)
+{
+	const std::vector<int>& plan = mAgents[agent].plan;
+	for (size_t i = 0; i < plan.size(); i++)
+	{
+		mReservations.Release(plan[i], mNow + static_cast<int>(i), agent);
+	}
+}
+
+// Distances are computed once per goal and dropped when the last agent heading there leaves
+const std::vector<int>& CooperativePlanner::AcquireDistances(int goal)
+{
+	GoalDistances& distances = mDistances[goal];
+	if (distances.users++ == 0)
+	{
+		ComputeDistances(goal, distances.distance);
+	}
+	return distances.distance;
+}
+
+void CooperativePlanner::ReleaseDistances(int goal)
+{
+	std::unordered_map<int, GoalDistances>::iterator distances = mDistances.find(goal);
+	if (distances != mDistances.end() && --distances->second.users == 0)
+	{
+		mDistances.erase(distances);
+	}
+}
+
+// Dijkstra out from the goal over the reversed steps, a step costs the terrain of the node it enters
+void CooperativePlanner::ComputeDistances(int goal, std::vector<int>& distance) const
+{
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	distance.assign(mGrid.columns * mGrid.rows, CostTraits<int>::Infinity());
+	distance[goal] = 0;
+	OpenEntryGreater<int> greater;
+	std::vector<OpenEntry<int> > openSet;
+	OpenEntry<int> goalEntry = { 0, 0, goal };
+	openSet.push_back(goalEntry);
+
+	while (openSet.size() > 0)
+	{
+		std::pop_heap(openSet.begin(), openSet.end(), greater);
+		const OpenEntry<int> entry = openSet.back();
+		openSet.pop_back();
+		if (entry.fCost > distance[entry.id])
+		{
+			continue;
+		}
+
+		const int x = entry.id / mGrid.rows;
+		const int y = entry.id % mGrid.rows;
+		const int terrainCost = mGrid.GetTerrainCost(entry.id);
+		for (int i = 0; i < mConfig.connectivity; i++)
+		{
+			const int neighborX = x + offsetX[i];
+			const int neighborY = y + offsetY[i];
+			// Steps are symmetric, so the neighbor can step here whenever this node can step there
+			if (!mGrid.CanStep(x, y, neighborX, neighborY, mConfig.cutCorners))
+			{
+				continue;
+			}
+			const int neighbor = mGrid.GetCellId(neighborX, neighborY);
+			const int cost = entry.fCost + (i >= 4 ? CostTraits<int>::Diagonal() : CostTraits<int>::Straight()) * terrainCost;
+			if (cost < distance[neighbor])
+			{
+				distance[neighbor] = cost;
+				OpenEntry<int> neighborEntry = { cost, 0, neighbor };
+				openSet.push_back(neighborEntry);
+				std::push_heap(openSet.begin(), openSet.end(), greater);
+			}
+		}
+	}
+}
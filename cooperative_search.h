@@ -0,0 +1,125 @@
+// Cooperative multi-agent pathfinding, windowed hierarchical cooperative A* (WHCA*)
+#ifndef COOPERATIVE_SEARCH_H
+#define COOPERATIVE_SEARCH_H
+
+#include "pathfinding.h"
+
+#include <unordered_map>
+#include <vector>
+
+// Ticks every agent plans ahead against the reservations of the others
+const int GLOBAL_CONST_COOPERATIVE_WINDOW = 16;
+// Value of a free cell in the reservation table
+const int GLOBAL_CONST_NO_AGENT = -1;
+
+// Which agent holds each cell at each tick of the window. Time is bucketed into a ring
+// one window long, each bucket hashing cell to agent, so expired ticks are dropped in one clear
+class ReservationTable
+{
+public:
+	ReservationTable();
+
+	// Drops every reservation and restarts the ring at now, window is the furthest tick ahead ever reserved
+	void Reset(int now, int window);
+	// Moves the ring forward to now, the ticks that passed are cleared
+	void Advance(int now);
+	// Returns the agent that held the cell at that tick, GLOBAL_CONST_NO_AGENT when it was free
+	int Reserve(int cell, int time, int agent);
+	// Frees the cell only if the agent still holds it
+	void Release(int cell, int time, int agent);
+	int GetHolder(int cell, int time) const;
+	size_t GetReservationCount() const;
+
+private:
+	std::vector<std::unordered_map<int, int> > mBuckets;
+	size_t mMask;
+	int mNow;
+};
+
+// Counters of one Step
+struct CooperativeStats
+{
+	int replans;
+	// Agents resting on their goal that were asked to step aside
+	int bumps;
+	// Replans that found no conflict free way to the end of the window, the agent waits instead
+	int failures;
+	int statesExpanded;
+	double stepMs;
+};
+
+// Plans agents in (cell, time) space one after another, each against the reservations of the
+// agents planned before it. Agents only plan GLOBAL_CONST_COOPERATIVE_WINDOW ticks ahead and the
+// search is finished with the true distance to the goal, so a replan costs the same on any map size.
+// Replans are staggered over the ticks so only a share of the agents searches each Step, which
+// also rotates the order agents reserve in. Agents resting on their goal give way, whoever needs
+// their cell bumps them into replanning right away instead of waiting for them forever
+class CooperativePlanner
+{
+public:
+	CooperativePlanner();
+
+	// Removes every agent. Only the connectivity and corner cutting of the config apply, costs are int
+	void SetGrid(const GridView& grid, const SearchConfig& config);
+	// Agents replan every interval ticks, clamped to the window
+	void SetReplanInterval(int interval);
+	// Returns the agent index, the agent plans on the next Step
+	int AddAgent(int start, int goal);
+	void SetGoal(int agent, int goal);
+	// Replans the agents that are due and moves every agent one tick along its plan
+	void Step();
+
+	int GetAgentCount() const { return static_cast<int>(mAgents.size()); }
+	int GetPosition(int agent) const { return mAgents[agent].plan[0]; }
+	int GetGoal(int agent) const { return mAgents[agent].goal; }
+	// Cells the agent will be on from this tick on, one per tick
+	const std::vector<int>& GetPlan(int agent) const { return mAgents[agent].plan; }
+	const CooperativeStats& GetStats() const { return mStats; }
+	int GetTime() const { return mNow; }
+
+private:
+	struct Agent
+	{
+		int goal;
+		// plan[0] is the current cell
+		std::vector<int> plan;
+		int nextReplan;
+		// On the goal and planning to stay there for the whole window
+		bool resting;
+	};
+
+	// Exact cost to a goal from every cell, shared by the agents heading there
+	struct GoalDistances
+	{
+		std::vector<int> distance;
+		int users;
+	};
+
+	void Replan(int agent);
+	// Space time A* over the window, fills path with a cell per tick. False when every way is blocked
+	bool FindWindowPath(int agent, std::vector<int>& path);
+	bool IsFree(int agent, int from, int to, int time) const;
+	void ReservePlan(int agent, std::vector<int>& displaced);
+	void ReleasePlan(int agent);
+	const std::vector<int>& AcquireDistances(int goal);
+	void ReleaseDistances(int goal);
+	void ComputeDistances(int goal, std::vector<int>& distance) const;
+
+	GridView mGrid;
+	SearchConfig mConfig;
+	int mReplanInterval;
+	int mNow;
+	std::vector<Agent> mAgents;
+	ReservationTable mReservations;
+	std::unordered_map<int, GoalDistances> mDistances;
+	// Window search state, states are indexed inside the box the window can reach around the start
+	SearchSpace<int> mSearch;
+	// Scratch buffers of Step and Replan, kept between ticks
+	std::vector<int> mBumpQueue;
+	std::vector<int> mReplanCount;
+	std::vector<int> mWindowPath;
+	std::vector<int> mDisplaced;
+	CooperativeStats mStats;
+};
+
+#endif
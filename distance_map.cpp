@@ -0,0 +1,159 @@
+#include "distance_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+DistanceMap::DistanceMap()
+{
+	mColumns = 0;
+	mRows = 0;
+	mUpdatedCount = 0;
+}
+
+// Every wall is queued as the source of a lowering wave, one pass over the queue fills the map
+void DistanceMap::Reset(const GridView& grid)
+{
+	mColumns = grid.columns;
+	mRows = grid.rows;
+	const int nodeCount = mColumns * mRows;
+	mWall.assign(nodeCount, 0);
+	mSquaredDistance.assign(nodeCount, std::numeric_limits<int>::max());
+	mNearestWall.assign(nodeCount, GLOBAL_CONST_NO_WALL);
+	mRaise.assign(nodeCount, 0);
+	mQueueState.assign(nodeCount, QUEUE_NONE);
+	mQueue.clear();
+	for (int id = 0; id < nodeCount; id++)
+	{
+		if (((grid.walkableBits[id >> 3] >> (id & 7)) & 1) == 0)
+		{
+			SetWall(id, true);
+		}
+	}
+	Update();
+}
+
+void DistanceMap::SetWall(int id, bool wall)
+{
+	if ((mWall[id] != 0) == wall)
+	{
+		return;
+	}
+	mWall[id] = wall;
+	if (wall)
+	{
+		mSquaredDistance[id] = 0;
+		mNearestWall[id] = id;
+		mRaise[id] = 0;
+	}
+	else
+	{
+		mSquaredDistance[id] = std::numeric_limits<int>::max();
+		mNearestWall[id] = GLOBAL_CONST_NO_WALL;
+		mRaise[id] = 1;
+	}
+	Push(id, 0);
+}
+
+void DistanceMap::Update()
+{
+	mUpdatedCount = 0;
+	while (!mQueue.empty())
+	{
+		const int id = mQueue.front().id;
+		std::pop_heap(mQueue.begin(), mQueue.end(), QueueEntryGreater());
+		mQueue.pop_back();
+		if (mQueueState[id] != QUEUE_WAITING)
+		{
+			continue;
+		}
+		mQueueState[id] = QUEUE_DONE;
+		mUpdatedCount++;
+		if (mRaise[id])
+		{
+			Raise(id);
+		}
+		else if (IsValidWall(mNearestWall[id]))
+		{
+			Lower(id);
+		}
+	}
+}
+
+float DistanceMap::GetDistance(int id) const
+{
+	if (mNearestWall[id] == GLOBAL_CONST_NO_WALL)
+	{
+		return std::numeric_limits<float>::infinity();
+	}
+	return std::sqrt(static_cast<float>(mSquaredDistance[id]));
+}
+
+void DistanceMap::Push(int id, int squaredDistance)
+{
+	mQueue.push_back(QueueEntry{ squaredDistance, id });
+	std::push_heap(mQueue.begin(), mQueue.end(), QueueEntryGreater());
+	mQueueState[id] = QUEUE_WAITING;
+}
+
+// Neighbors still pointing at a standing wall border the cleared region, they are queued to lower it again
+void DistanceMap::Raise(int id)
+{
+	const int x = id / mRows;
+	const int y = id % mRows;
+	for (int neighborX = std::max(0, x - 1); neighborX <= std::min(mColumns - 1, x + 1); neighborX++)
+	{
+		for (int neighborY = std::max(0, y - 1); neighborY <= std::min(mRows - 1, y + 1); neighborY++)
+		{
+			const int neighbor = neighborX * mRows + neighborY;
+			if (neighbor == id || mNearestWall[neighbor] == GLOBAL_CONST_NO_WALL || mRaise[neighbor])
+			{
+				continue;
+			}
+			if (!IsValidWall(mNearestWall[neighbor]))
+			{
+				// Queued at the distance it had so the raising wave moves outwards in order
+				Push(neighbor, mSquaredDistance[neighbor]);
+				mSquaredDistance[neighbor] = std::numeric_limits<int>::max();
+				mNearestWall[neighbor] = GLOBAL_CONST_NO_WALL;
+				mRaise[neighbor] = 1;
+			}
+			else if (mQueueState[neighbor] != QUEUE_WAITING)
+			{
+				Push(neighbor, mSquaredDistance[neighbor]);
+			}
+		}
+	}
+	mRaise[id] = 0;
+}
+
+void DistanceMap::Lower(int id)
+{
+	const int wall = mNearestWall[id];
+	const int wallX = wall / mRows;
+	const int wallY = wall % mRows;
+	const int x = id / mRows;
+	const int y = id % mRows;
+	for (int neighborX = std::max(0, x - 1); neighborX <= std::min(mColumns - 1, x + 1); neighborX++)
+	{
+		for (int neighborY = std::max(0, y - 1); neighborY <= std::min(mRows - 1, y + 1); neighborY++)
+		{
+			const int neighbor = neighborX * mRows + neighborY;
+			if (neighbor == id || mRaise[neighbor])
+			{
+				continue;
+			}
+			const int dx = neighborX - wallX;
+			const int dy = neighborY - wallY;
+			const int squaredDistance = dx * dx + dy * dy;
+			// A tie still takes over a neighbor whose wall is gone
+			if (squaredDistance < mSquaredDistance[neighbor]
+				|| (squaredDistance == mSquaredDistance[neighbor] && !IsValidWall(mNearestWall[neighbor])))
+			{
+				mSquaredDistance[neighbor] = squaredDistance;
+				mNearestWall[neighbor] = wall;
+				Push(neighbor, squaredDistance);
+			}
+		}
+	}
+}
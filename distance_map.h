@@ -0,0 +1,79 @@
+// Distance from every node to its nearest wall, maintained incrementally as walls are painted and erased
+#ifndef DISTANCE_MAP_H
+#define DISTANCE_MAP_H
+
+#include "pathfinding.h"
+
+#include <vector>
+
+// Nearest wall of a node when the grid has no wall at all
+const int GLOBAL_CONST_NO_WALL = -1;
+
+// Dynamic brushfire distance transform. Every node keeps its nearest wall and the squared Euclidean
+// distance to it. Placing a wall sends a lowering wave out until it meets nodes that are already closer
+// to another wall; removing one first sends a raising wave that clears the nodes that pointed at it, then
+// the walls bordering that region lower it again. Edits only touch the nodes whose nearest wall changes.
+// Walls propagate through the 8 neighbors, like any brushfire the result can be off by a fraction of
+// a node in rare ties, which costs and heatmaps do not notice
+class DistanceMap
+{
+public:
+	DistanceMap();
+
+	// Sizes the map for the grid and recomputes every distance from its walls
+	void Reset(const GridView& grid);
+	// Queues the change of a node, Update propagates it. Queuing a whole brush stroke first is cheaper
+	void SetWall(int id, bool wall);
+	// Processes every queued change
+	void Update();
+
+	bool IsWall(int id) const { return mWall[id] != 0; }
+	// Squared distance in nodes, std::numeric_limits<int>::max() when the grid has no wall
+	int GetSquaredDistance(int id) const { return mSquaredDistance[id]; }
+	// Distance in nodes, infinity when the grid has no wall
+	float GetDistance(int id) const;
+	int GetNearestWall(int id) const { return mNearestWall[id]; }
+	// Nodes the last Update visited, a whole map for Reset
+	int GetUpdatedCount() const { return mUpdatedCount; }
+
+private:
+	// Queue state of a node, stale queue entries of processed nodes are skipped
+	enum QueueState
+	{
+		QUEUE_NONE,
+		QUEUE_WAITING,
+		QUEUE_DONE
+	};
+
+	struct QueueEntry
+	{
+		int squaredDistance;
+		int id;
+	};
+
+	struct QueueEntryGreater
+	{
+		bool operator()(const QueueEntry& a, const QueueEntry& b) const { return a.squaredDistance > b.squaredDistance; }
+	};
+
+	void Push(int id, int squaredDistance);
+	// Clears the neighbors whose nearest wall is gone and queues their distance to be recomputed
+	void Raise(int id);
+	// Hands the nearest wall of the node on to the neighbors it is closer to
+	void Lower(int id);
+	bool IsValidWall(int id) const { return id != GLOBAL_CONST_NO_WALL && mWall[id] != 0; }
+
+	int mColumns;
+	int mRows;
+	std::vector<unsigned char> mWall;
+	std::vector<int> mSquaredDistance;
+	std::vector<int> mNearestWall;
+	// Set on nodes whose nearest wall was removed until the raising wave passes them
+	std::vector<unsigned char> mRaise;
+	std::vector<unsigned char> mQueueState;
+	// Binary heap ordered by QueueEntryGreater, the closest node on top
+	std::vector<QueueEntry> mQueue;
+	int mUpdatedCount;
+};
+
+#endif
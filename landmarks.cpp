@@ -0,0 +1,280 @@
+#include "landmarks.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+
+// Distance stored for nodes a landmark cannot reach. Any value keeps the bound admissible since no path
+// joins the two sides, the wide one leaves room for the search to add it to a cost without overflowing
+const uint16_t GLOBAL_CONST_LANDMARK_UNREACHABLE_NARROW = 0xffff;
+const uint32_t GLOBAL_CONST_LANDMARK_UNREACHABLE_WIDE = 0x3fffffff;
+// Roots of the avoid selection are drawn from a fixed seed so a map always gets the same landmarks
+const unsigned int GLOBAL_CONST_LANDMARK_SEED = 1;
+
+LandmarkTable::LandmarkTable()
+{
+	mGrid = GridView();
+	mNodeCount = 0;
+	mStride = 0;
+	mWide = false;
+}
+
+void LandmarkTable::Clear()
+{
+	mNodeCount = 0;
+	mStride = 0;
+	mWide = false;
+	mLandmarks.clear();
+	mNarrowDistances.clear();
+	mWideDistances.clear();
+}
+
+// Rows are filled wide while the landmarks are picked, avoid needs the bounds of the ones already placed.
+// They are narrowed at the end when every finite distance fits below the uint16 sentinel
+bool LandmarkTable::Build(const GridView& grid, int count, LandmarkSelection selection)
+{
+	Clear();
+	if (count < 1 || count > GLOBAL_CONST_MAX_LANDMARKS)
+	{
+		PathfindingLog("Landmark count %d is outside 1 to %d", count, GLOBAL_CONST_MAX_LANDMARKS);
+		return false;
+	}
+	mGrid = grid;
+	mNodeCount = grid.columns * grid.rows;
+	std::vector<int> walkableNodes;
+	for (int id = 0; id < mNodeCount; id++)
+	{
+		if (IsWalkable(id / grid.rows, id % grid.rows))
+		{
+			walkableNodes.push_back(id);
+		}
+	}
+	if (walkableNodes.empty())
+	{
+		PathfindingLog("Landmarks need at least one walkable node");
+		Clear();
+		return false;
+	}
+
+	mStride = (count + GLOBAL_CONST_LANDMARK_LANES - 1) / GLOBAL_CONST_LANDMARK_LANES * GLOBAL_CONST_LANDMARK_LANES;
+	mWide = true;
+	mWideDistances.assign(static_cast<size_t>(mNodeCount) * mStride, 0);
+	mDistance.resize(mNodeCount);
+	mParent.resize(mNodeCount);
+
+	// Closest landmark distance of every node, for the farthest point selection
+	std::vector<int> nearest(mNodeCount, std::numeric_limits<int>::max());
+	std::mt19937 random(GLOBAL_CONST_LANDMARK_SEED);
+	std::uniform_int_distribution<int> anyNode(0, static_cast<int>(walkableNodes.size()) - 1);
+	// The first farthest point is measured from an arbitrary node, it ends up on the rim of the map
+	ComputeDistances(walkableNodes[0], mDistance, mParent, mOrder);
+	int landmark = mOrder.back();
+	while (static_cast<int>(mLandmarks.size()) < count)
+	{
+		if (selection == LANDMARK_AVOID)
+		{
+			landmark = PickAvoid(walkableNodes[anyNode(random)]);
+			if (landmark < 0)
+			{
+				landmark = PickFarthest(nearest);
+			}
+		}
+		if (landmark < 0)
+		{
+			break;
+		}
+		ComputeDistances(landmark, mDistance, mParent, mOrder);
+		StoreRow(landmark, mDistance);
+		for (int id = 0; id < mNodeCount; id++)
+		{
+			nearest[id] = std::min(nearest[id], mDistance[id]);
+		}
+		landmark = PickFarthest(nearest);
+	}
+
+	uint32_t longest = 0;
+	for (uint32_t distance:mWideDistances)
+	{
+		if (distance != GLOBAL_CONST_LANDMARK_UNREACHABLE_WIDE)
+		{
+			longest = std::max(longest, distance);
+		}
+	}
+	if (longest < GLOBAL_CONST_LANDMARK_UNREACHABLE_NARROW)
+	{
+		mNarrowDistances.resize(mWideDistances.size());
+		for (size_t i = 0; i < mWideDistances.size(); i++)
+		{
+			const uint32_t distance = mWideDistances[i];
+			mNarrowDistances[i] = distance == GLOBAL_CONST_LANDMARK_UNREACHABLE_WIDE ? GLOBAL_CONST_LANDMARK_UNREACHABLE_NARROW : static_cast<uint16_t>(distance);
+		}
+		std::vector<uint32_t>().swap(mWideDistances);
+		mWide = false;
+	}
+	return true;
+}
+
+bool LandmarkTable::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= mGrid.columns || y < 0 || y >= mGrid.rows)
+	{
+		return false;
+	}
+	const int id = mGrid.GetCellId(x, y);
+	return (mGrid.walkableBits[id >> 3] >> (id & 7)) & 1;
+}
+
+void LandmarkTable::ComputeDistances(int source, std::vector<int>& distance, std::vector<int>& parent, std::vector<int>& order)
+{
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	std::fill(distance.begin(), distance.end(), std::numeric_limits<int>::max());
+	order.clear();
+	mOpenSet.clear();
+	OpenEntryGreater<int> greater;
+	distance[source] = 0;
+	parent[source] = source;
+	mOpenSet.push_back(OpenEntry<int>{ 0, 0, source });
+	while (!mOpenSet.empty())
+	{
+		std::pop_heap(mOpenSet.begin(), mOpenSet.end(), greater);
+		const OpenEntry<int> entry = mOpenSet.back();
+		mOpenSet.pop_back();
+		const int current = entry.id;
+		if (entry.fCost != distance[current])
+		{
+			continue;
+		}
+		order.push_back(current);
+
+		const int x = current / mGrid.rows;
+		const int y = current % mGrid.rows;
+		const int currentTerrain = mGrid.GetTerrainCost(current);
+		for (int i = 0; i < 8; i++)
+		{
+			const int neighborX = x + offsetX[i];
+			const int neighborY = y + offsetY[i];
+			if (!IsWalkable(neighborX, neighborY))
+			{
+				continue;
+			}
+			const int neighbor = mGrid.GetCellId(neighborX, neighborY);
+			const int step = i >= 4 ? CostTraits<int>::Diagonal() : CostTraits<int>::Straight();
+			const int cost = entry.fCost + step * std::min(currentTerrain, mGrid.GetTerrainCost(neighbor));
+			if (cost < distance[neighbor])
+			{
+				distance[neighbor] = cost;
+				parent[neighbor] = current;
+				mOpenSet.push_back(OpenEntry<int>{ cost, cost, neighbor });
+				std::push_heap(mOpenSet.begin(), mOpenSet.end(), greater);
+			}
+		}
+	}
+}
+
+// A node no landmark reaches yet wins outright, so every connected region gets one before any gets two.
+// Returns -1 once every walkable node is a landmark
+int LandmarkTable::PickFarthest(const std::vector<int>& nearest) const
+{
+	int best = -1;
+	for (int id = 0; id < mNodeCount; id++)
+	{
+		if (IsWalkable(id / mGrid.rows, id % mGrid.rows) && (best < 0 || nearest[id] > nearest[best]))
+		{
+			best = id;
+		}
+	}
+	if (best >= 0 && nearest[best] == 0)
+	{
+		return -1;
+	}
+	return best;
+}
+
+// Weighs every node of the shortest path tree of root by how much the current bound underestimates
+// its distance, subtrees already holding a landmark weigh nothing. The new landmark is the leaf reached
+// from the heaviest subtree by always descending into the heaviest child. Returns -1 when nothing is left to improve
+int LandmarkTable::PickAvoid(int root)
+{
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	ComputeDistances(root, mDistance, mParent, mOrder);
+	std::vector<long long> size(mNodeCount, 0);
+	std::vector<unsigned char> covered(mNodeCount, 0);
+	for (int landmark:mLandmarks)
+	{
+		covered[landmark] = 1;
+	}
+	// Settled order has every parent before its children, walking it backwards sums the subtrees
+	for (size_t i = mOrder.size(); i-- > 0;)
+	{
+		const int node = mOrder[i];
+		if (covered[node])
+		{
+			size[node] = 0;
+		}
+		else
+		{
+			size[node] += mDistance[node] - Estimate(root, node);
+		}
+		if (node != root)
+		{
+			const int parent = mParent[node];
+			if (covered[node])
+			{
+				covered[parent] = 1;
+			}
+			size[parent] += size[node];
+		}
+	}
+	int node = root;
+	for (int candidate:mOrder)
+	{
+		if (size[candidate] > size[node])
+		{
+			node = candidate;
+		}
+	}
+	if (size[node] == 0)
+	{
+		return -1;
+	}
+	while (true)
+	{
+		const int x = node / mGrid.rows;
+		const int y = node % mGrid.rows;
+		int heaviest = -1;
+		for (int i = 0; i < 8; i++)
+		{
+			const int neighborX = x + offsetX[i];
+			const int neighborY = y + offsetY[i];
+			if (!IsWalkable(neighborX, neighborY))
+			{
+				continue;
+			}
+			const int neighbor = mGrid.GetCellId(neighborX, neighborY);
+			if (mParent[neighbor] == node && size[neighbor] > 0 && (heaviest < 0 || size[neighbor] > size[heaviest]))
+			{
+				heaviest = neighbor;
+			}
+		}
+		if (heaviest < 0)
+		{
+			return node;
+		}
+		node = heaviest;
+	}
+}
+
+void LandmarkTable::StoreRow(int landmark, const std::vector<int>& distance)
+{
+	const int lane = static_cast<int>(mLandmarks.size());
+	mLandmarks.push_back(landmark);
+	for (int id = 0; id < mNodeCount; id++)
+	{
+		const bool reached = distance[id] != std::numeric_limits<int>::max() && static_cast<uint32_t>(distance[id]) < GLOBAL_CONST_LANDMARK_UNREACHABLE_WIDE;
+		mWideDistances[static_cast<size_t>(id) * mStride + lane] = reached ? static_cast<uint32_t>(distance[id]) : GLOBAL_CONST_LANDMARK_UNREACHABLE_WIDE;
+	}
+}
@@ -0,0 +1,96 @@
+// ALT heuristic: exact distances from a few landmarks bound the distance between any two nodes
+#ifndef LANDMARKS_H
+#define LANDMARKS_H
+
+#include "pathfinding.h"
+
+#include <vector>
+
+// Landmarks a table can hold, each costs 2 or 4 bytes per node
+const int GLOBAL_CONST_MAX_LANDMARKS = 32;
+// Rows are padded to a multiple of this many landmarks so the estimate runs on whole vector registers
+const int GLOBAL_CONST_LANDMARK_LANES = 8;
+
+enum LandmarkSelection
+{
+	// Each landmark is the node farthest from the ones picked so far
+	LANDMARK_FARTHEST,
+	// Goldberg and Werneck's avoid: grows a shortest path tree from a random root and takes the leaf
+	// of the subtree the current landmarks bound worst
+	LANDMARK_AVOID
+};
+
+// Distances from every landmark to every node, stored node by node so an estimate reads one row per node.
+// Distances are in int search units (10 straight, 14 diagonal, times the terrain cost) over every walkable
+// node with eight-connected corner cutting moves, stepping between two nodes costs the cheaper of their
+// terrains. That graph only ever makes paths cheaper than the searched one, in both directions, so
+// |d(L, node) - d(L, target)| stays a lower bound for every grid search config, agent size and cost type.
+// The table holds uint16 distances when the map is small enough, uint32 otherwise
+class LandmarkTable
+{
+public:
+	LandmarkTable();
+
+	// Picks count landmarks and runs a Dijkstra from each. Rebuild after editing walls or terrain,
+	// a table older than the grid can overestimate
+	bool Build(const GridView& grid, int count, LandmarkSelection selection);
+	void Clear();
+
+	bool IsEmpty() const { return mLandmarks.empty(); }
+	int GetNodeCount() const { return mNodeCount; }
+	const std::vector<int>& GetLandmarks() const { return mLandmarks; }
+	bool IsWide() const { return mWide; }
+	size_t GetMemoryBytes() const { return mNarrowDistances.size() * sizeof(uint16_t) + mWideDistances.size() * sizeof(uint32_t); }
+
+	// Lower bound on the int cost between two nodes, the largest triangle inequality over the landmarks
+	int Estimate(int node, int target) const
+	{
+		if (mWide)
+		{
+			return EstimateRows(&mWideDistances[static_cast<size_t>(node) * mStride], &mWideDistances[static_cast<size_t>(target) * mStride]);
+		}
+		return EstimateRows(&mNarrowDistances[static_cast<size_t>(node) * mStride], &mNarrowDistances[static_cast<size_t>(target) * mStride]);
+	}
+
+private:
+	// Fixed width inner loop, the compiler turns each block of lanes into a few vector instructions
+	template <typename DistanceT>
+	int EstimateRows(const DistanceT* node, const DistanceT* target) const
+	{
+		DistanceT best = 0;
+		for (int block = 0; block < mStride; block += GLOBAL_CONST_LANDMARK_LANES)
+		{
+			for (int lane = 0; lane < GLOBAL_CONST_LANDMARK_LANES; lane++)
+			{
+				const DistanceT a = node[block + lane];
+				const DistanceT b = target[block + lane];
+				const DistanceT difference = a > b ? a - b : b - a;
+				best = difference > best ? difference : best;
+			}
+		}
+		return static_cast<int>(best);
+	}
+
+	// Dijkstra over the landmark graph, order receives the nodes as they were settled
+	void ComputeDistances(int source, std::vector<int>& distance, std::vector<int>& parent, std::vector<int>& order);
+	int PickFarthest(const std::vector<int>& nearest) const;
+	int PickAvoid(int root);
+	void StoreRow(int landmark, const std::vector<int>& distance);
+	bool IsWalkable(int x, int y) const;
+
+	GridView mGrid;
+	int mNodeCount;
+	// Landmarks rounded up to GLOBAL_CONST_LANDMARK_LANES, the padding lanes stay 0 on every node
+	int mStride;
+	bool mWide;
+	std::vector<int> mLandmarks;
+	std::vector<uint16_t> mNarrowDistances;
+	std::vector<uint32_t> mWideDistances;
+	// Dijkstra scratch, kept between landmarks
+	std::vector<int> mDistance;
+	std::vector<int> mParent;
+	std::vector<int> mOrder;
+	std::vector<OpenEntry<int> > mOpenSet;
+};
+
+#endif
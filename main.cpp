@@ -1,14 +1,50 @@
 #include <SDL2/SDL.h>
+#include "pathfinding.h"
+#include "distance_map.h"
+#include "landmarks.h"
+#include "subgoal_graph.h"
 #include <stdio.h>
 #include <vector>
 #include <iostream>
 #include <cstdio>
 #include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <sys/stat.h>
 
 const int GLOBAL_CONST_WINDOW_WIDTH = 700;
 const int GLOBAL_CONST_WINDOW_HEIGHT = 700;
 const float GLOBAL_CONST_GRID_SIZE = 0.05;
+// Grids drawn bigger than this fall back to drawing their visible lines every frame
+const int GLOBAL_CONST_MAX_GRID_TEXTURE_SIZE = 4096;
+// Dirty map regions kept apart before they are merged into one upload
+const size_t GLOBAL_CONST_MAX_DIRTY_RECTS = 64;
+// Grid lines are hidden once nodes get smaller than this on screen
+const float GLOBAL_CONST_MIN_GRID_LINE_SPACING = 4.0f;
+const float GLOBAL_CONST_MAX_ZOOM = 4.0f;
+// Zoom applied per mouse wheel notch or +/- key press
+const float GLOBAL_CONST_ZOOM_STEP = 1.25f;
+// Pixels the arrow keys pan the view per frame
+const float GLOBAL_CONST_PAN_SPEED = 12.0f;
+// Samples the overlay timers average and rank over
+const size_t GLOBAL_CONST_TIMING_WINDOW = 120;
+// Screen pixels per pixel of the 3x5 overlay font
+const int GLOBAL_CONST_FONT_SCALE = 2;
+const char* const GLOBAL_CONST_STATS_FILE = "pathfinding_stats.csv";
+// Map file used when none is given on the command line, F5 saves to it
+const char* const GLOBAL_CONST_MAP_FILE = "map.pfmap";
+// Agent sizes the K key cycles through, in nodes
+const int GLOBAL_CONST_EDITOR_MAX_AGENT_SIZE = 4;
+// Landmarks of the table the simulation thread builds for the landmark heuristic
+const int GLOBAL_CONST_EDITOR_LANDMARKS = 8;
 
 struct Vector2 {
 	float x;
@@ -25,13 +61,6 @@ public:
 	Vector2 GetPosition() { return mPosition; };
 	int GetId() { return mID; }
 
-	// Used for to calculate A* algorithm
-	int gCost;
-	int hCost;
-	int fCost() { return gCost + hCost; };
-	bool walkable;
-	std::vector<Node> parent;
-
 	bool operator==(const Node &node)
 	{
 		return (this->mID == node.mID);
@@ -53,16 +82,131 @@ Node::Node(SDL_Rect rect, int id)
 	mID = id;
 	mPosition.x = static_cast<int>(rect.x + rect.w/2);
 	mPosition.y = static_cast<int>(rect.y + rect.h/2);
-	walkable = true;
 }
+// Rolling window over the last GLOBAL_CONST_TIMING_WINDOW samples of a timer
+class TimingSeries
+{
+public:
+	TimingSeries();
+
+	void Add(double sample);
+	bool IsEmpty() const { return mSamples.empty(); }
+	double GetAverage() const;
+	// Nearest rank percentile, fraction runs from 0 to 1
+	double GetPercentile(double fraction) const;
+
+private:
+	std::vector<double> mSamples;
+	// Oldest sample once the window is full
+	size_t mNext;
+	// Scratch copy the percentiles are selected in
+	mutable std::vector<double> mSorted;
+};
+
+TimingSeries::TimingSeries()
+{
+	mNext = 0;
+	mSamples.reserve(GLOBAL_CONST_TIMING_WINDOW);
+}
+
+void TimingSeries::Add(double sample)
+{
+	if (mSamples.size() < GLOBAL_CONST_TIMING_WINDOW)
+	{
+		mSamples.push_back(sample);
+		return;
+	}
+	mSamples[mNext] = sample;
+	mNext = (mNext + 1) % mSamples.size();
+}
+
+double TimingSeries::GetAverage() const
+{
+	if (mSamples.empty())
+	{
+		return 0.0;
+	}
+	double sum = 0.0;
+	for (double sample:mSamples)
+	{
+		sum += sample;
+	}
+	return sum / mSamples.size();
+}
+
+double TimingSeries::GetPercentile(double fraction) const
+{
+	if (mSamples.empty())
+	{
+		return 0.0;
+	}
+	mSorted.assign(mSamples.begin(), mSamples.end());
+	size_t rank = static_cast<size_t>(std::ceil(fraction * mSorted.size()));
+	rank = std::min(mSorted.size() - 1, rank > 0 ? rank - 1 : 0);
+	std::nth_element(mSorted.begin(), mSorted.begin() + rank, mSorted.end());
+	return mSorted[rank];
+}
+
+// Immutable copy of everything a search reads, published by the main thread for the simulation thread
+struct WorldSnapshot
+{
+	int columns;
+	int rows;
+	// Packed like GridView::walkableBits
+	std::vector<unsigned char> walkableBits;
+	std::vector<unsigned char> terrainCost;
+	int minTerrainCost;
+	std::vector<unsigned char> clearance;
+	// -1 while the endpoints are not both placed
+	int start;
+	int target;
+	SearchConfig config;
+	unsigned int version;
+	// Moves on every wall or terrain edit, the landmark table and subgoal graph are rebuilt when it does
+	unsigned int mapVersion;
+	// Set while a paint stroke is under way, derived tables wait for it to end before they are rebuilt
+	bool editing;
+	// Every node has the same terrain cost, which the subgoal graph needs
+	bool uniformTerrain;
+};
 
+// Search result handed back to the main thread, tagged with the world version it was computed on
+struct PathSnapshot
+{
+	std::vector<int> path;
+	bool found;
+	SearchStats stats;
+	// Search trace events oldest first, empty unless the query recorded them
+	std::vector<unsigned int> trace;
+	unsigned int version;
+};
+
+// View onto the map, the top left corner in nodes and the zoom applied to the node size
+struct Camera
+{
+	float x;
+	float y;
+	float zoom;
+};
+
+// One level of the map texture pyramid, level 0 has a texel per node and
+// every level above keeps the brightest channels of 2x2 texels of the one below
+struct MapLevel
+{
+	SDL_Texture* texture;
+	int width;
+	int height;
+	std::vector<Uint32> pixels;
+};
 
 class Pathfinding
 {
 public:
 	Pathfinding();
 	
-	bool Initialize();
+	// Grids larger than the window are explored with the camera. The map is loaded from
+	// mapPath when it exists, otherwise a blank grid is made and F5 saves it there or to GLOBAL_CONST_MAP_FILE
+	bool Initialize(int columns, int rows, const char* mapPath);
 	
 	void RunLoop();
 	
@@ -71,12 +215,60 @@ private:
 	void ProcessInput();
 	void GenerateOutput();
 
-	void MakeNodes(int windowWidth, int windowHeight);
+	void MakeNodes(int columns, int rows);
+	// Copies walls and terrain out of a map file, the grid must already have its size
+	void LoadMap(const MapFile& file);
+	bool SaveMap(const char* path) const;
+	bool CreateMapTexture();
+	Uint32 GetNodeColor(int id) const;
+	void SetNodeTexel(int id, Uint32 color);
+	void MarkMapDirty(const SDL_Rect& rect);
+	void RebuildMapPixels();
+	void UploadMapTexture();
+	void AggregateMapLevel(int level, const SDL_Rect& rect);
+	void RebuildPathOverlay();
+	void DrawMap(int windowWidth, int windowHeight);
+	// Texels of a map level with scale nodes per texel covering the window, false when none are visible
+	bool GetVisibleTexels(int windowWidth, int windowHeight, int scale, int width, int height, SDL_Rect& source, SDL_Rect& destination) const;
+	// Heat layer of the last search trace, nodes expanded early are blue and late ones red
+	void RebuildTraceLayer(const std::vector<unsigned int>& trace);
+	void DrawTraceLayer(int windowWidth, int windowHeight);
 	void DrawGrid(SDL_Renderer* renderer, int windowWidth, int windowHeight);
-	void FindPath(Node start, Node target);
-	void RetracePath(Node start, Node target);
-	std::vector<Node> GetNeighbors(Node node);
-	int GetDistance(Node nodeA, Node nodeB);
+	void RenderGridTexture(SDL_Renderer* renderer, int gridWidth, int gridHeight);
+	void DrawGridLines(SDL_Renderer* renderer, const SDL_Rect& area, int originX, int originY);
+	// Node size on screen at the current zoom
+	float GetViewNodeWidth() const { return mNodeWidth * mCamera.zoom; }
+	float GetViewNodeHeight() const { return mNodeHeight * mCamera.zoom; }
+	// Window position of a point given in nodes from the top left of the map
+	SDL_Point GridToScreen(float column, float row) const;
+	void PanBy(float dx, float dy);
+	void ZoomAt(int x, int y, float factor);
+	// Timings and search counters drawn over the map, toggled with T. Takes the node under the cursor the frame found
+	void DrawOverlay(int hoveredId);
+	void DrawText(int x, int y, const char* text);
+	void DrawTimingLine(int x, int y, const char* name, const TimingSeries& series);
+	bool ExportStats(const char* path) const;
+	// Searches run on the simulation thread against snapshots of the world,
+	// the main thread publishes a snapshot after edits and picks up finished paths
+	void SimulationLoop();
+	void PublishWorld();
+	// Widens the columns every world buffer has to copy on its next publish
+	void MarkWorldDirty(int beginColumn, int endColumn);
+	void ReceivePath();
+	// Maps a window position to the id of the node under it, -1 outside the grid
+	int GetNodeAt(int x, int y) const;
+	// Returns true when the cost of the node changed
+	bool SetTerrainCost(int id, unsigned char cost);
+	// Paints or erases a single wall, the packed bits and the clearance around it follow
+	void SetWalkable(int id, bool walkable);
+	// Repacks and recomputes everything derived from mWalkable after a bulk change
+	void RebuildWalkability();
+	GridView GetGridView() const;
+	// Cheapest cost on the grid, scales the heuristic so it stays admissible
+	int GetMinTerrainCost() const;
+	SDL_Color GetTerrainColor(unsigned char cost) const;
+	void SelectTerrainBrush(unsigned char cost);
+	int GetCellId(int x, int y) const { return x * mRows + y; }
 	SDL_Window* mWindow;
 	// Renderer to draw graphics created by SDL
 	SDL_Renderer* mRenderer;
@@ -87,23 +279,101 @@ private:
 	bool mMouseDown;
 	bool mRightMouseDown;
 	bool mLeftMouseDown;
+	// Dragging with the middle button pans the view
+	bool mMiddleMouseDown;
 	// Current mouse location within the window
 	int mXMouse;
 	int mYMouse;
 
-	// Clears the following vectors if true
+	// Clears the following vectors if true, for one frame per press of E
 	bool mErase;
+	bool mEraseKeyDown;
 
 	// All the nodes in the program
 	std::vector<Node> mNodes;
-	// Nodes selected to be !walkable (walls, white)
-	std::vector<Node> mSelectedNodes;
 	// Nodes selected to make a path from (start, target)
 	std::vector<Node> mPathNodes;
-	// Nodes calculated as neighbors in the A* algorithm
-	std::vector<Node> mNeighbors;
-	// The final path retraced from finish to start
-	std::vector<Node> mPath;
+	// The final path retraced from start to finish, as node ids
+	std::vector<int> mPath;
+
+	// Grid dimensions in nodes, node ids run column by column
+	int mColumns;
+	int mRows;
+	// Size of a node in pixels at zoom 1
+	int mNodeWidth;
+	int mNodeHeight;
+	Camera mCamera;
+	// Walkability of every node indexed by id, 0 for walls
+	std::vector<unsigned char> mWalkable;
+	// mWalkable packed like GridView::walkableBits and the clearance of every node, kept in step with it
+	std::vector<unsigned char> mWalkableBits;
+	std::vector<unsigned char> mClearance;
+	// Distance of every node to its nearest wall, brush strokes only update the nodes around them
+	DistanceMap mWallDistance;
+	// Traversal cost multiplier of every node indexed by id
+	std::vector<unsigned char> mTerrainCost;
+	// How many nodes use each terrain cost
+	int mTerrainCostCount[256];
+	std::string mMapPath;
+
+	// Left mouse paints mTerrainBrush instead of walls while true
+	bool mTerrainTool;
+	unsigned char mTerrainBrush;
+
+	// Map texture pyramid, each level mirrors its texture row by row and edits
+	// only upload the level 0 regions queued in mMapDirtyRects and what they cover above
+	std::vector<MapLevel> mMapLevels;
+	std::vector<SDL_Rect> mMapDirtyRects;
+	// Nodes the path and endpoints are currently drawn over
+	std::vector<int> mPathTexels;
+	// Path polyline in window coordinates, refilled every frame from mPath
+	std::vector<SDL_Point> mPathPoints;
+	// Set by anything that can change the path, FindPath only runs when it is set
+	bool mPathDirty;
+
+	// Grid lines rendered once, along with the layout they were rendered for
+	SDL_Texture* mGridTexture;
+	bool mGridTextureDirty;
+	float mGridTextureZoom;
+	int mGridTextureColumns;
+	int mGridTextureRows;
+
+	SearchConfig mSearchConfig;
+
+	std::thread mSimulationThread;
+	std::mutex mSimulationMutex;
+	std::condition_variable mSimulationWake;
+	bool mSimulationRunning;
+	// Latest snapshots in flight between the threads, guarded by mSimulationMutex
+	std::shared_ptr<const WorldSnapshot> mLatestWorld;
+	std::shared_ptr<const PathSnapshot> mLatestPath;
+	// Triple buffered world snapshots, one is always free while the other
+	// two are at most the published one and the one being searched
+	std::shared_ptr<WorldSnapshot> mWorldBuffers[3];
+	// Columns edited since each world buffer was last filled, none while begin is not below end
+	int mWorldDirtyBegin[3];
+	int mWorldDirtyEnd[3];
+	// The last world published was in the middle of a paint stroke
+	bool mPublishedEditing;
+	unsigned int mWorldVersion;
+	unsigned int mMapVersion;
+
+	// Per frame timers, the search ones are fed as results come back
+	TimingSeries mFrameTiming;
+	TimingSeries mInputTiming;
+	TimingSeries mOutputTiming;
+	TimingSeries mFindPathTiming;
+	TimingSeries mRetraceTiming;
+	// Every query answered so far, exported with X
+	std::vector<SearchStats> mStatsHistory;
+	bool mShowOverlay;
+	// Font pixels of the overlay, drawn in one batch
+	std::vector<SDL_Rect> mOverlayRects;
+
+	// One texel per node, transparent where the last trace never reached
+	SDL_Texture* mTraceTexture;
+	std::vector<Uint32> mTracePixels;
+	bool mShowTrace;
 };
 
 Pathfinding::Pathfinding()
@@ -114,12 +384,42 @@ Pathfinding::Pathfinding()
 	mMouseDown = false;
 	mRightMouseDown = false;
 	mLeftMouseDown = false;
+	mMiddleMouseDown = false;
 	mErase = false;
+	mEraseKeyDown = false;
+	mColumns = 0;
+	mRows = 0;
+	mNodeWidth = 1;
+	mNodeHeight = 1;
+	mCamera.x = 0.0f;
+	mCamera.y = 0.0f;
+	mCamera.zoom = 1.0f;
+	mXMouse = -1;
+	mYMouse = -1;
+	mTerrainTool = false;
+	mTerrainBrush = TERRAIN_GROUND;
+	std::fill(mTerrainCostCount, mTerrainCostCount + 256, 0);
+	mPathDirty = true;
+	mGridTexture = nullptr;
+	mGridTextureDirty = true;
+	mGridTextureZoom = 0.0f;
+	mGridTextureColumns = 0;
+	mGridTextureRows = 0;
+	mSearchConfig = MakeDefaultSearchConfig();
+	mSimulationRunning = false;
+	mWorldVersion = 0;
+	mMapVersion = 0;
+	std::fill(mWorldDirtyBegin, mWorldDirtyBegin + 3, 0);
+	std::fill(mWorldDirtyEnd, mWorldDirtyEnd + 3, 0);
+	mPublishedEditing = false;
+	mShowOverlay = true;
+	mTraceTexture = nullptr;
+	mShowTrace = false;
 }
 
 // The Initialization function returns true 
 //if initialization succeeds and false otherwise
-bool Pathfinding::Initialize()
+bool Pathfinding::Initialize(int columns, int rows, const char* mapPath)
 {
 	int sdlResult = SDL_Init(SDL_INIT_VIDEO);
 
@@ -150,22 +450,278 @@ bool Pathfinding::Initialize()
 		SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC
 	);
 
-	MakeNodes(GLOBAL_CONST_WINDOW_WIDTH, GLOBAL_CONST_WINDOW_HEIGHT);
+	mMapPath = mapPath != nullptr ? mapPath : GLOBAL_CONST_MAP_FILE;
+	struct stat status;
+	if (mapPath != nullptr && stat(mapPath, &status) == 0)
+	{
+		MapFile file;
+		if (!file.Open(mMapPath.c_str()) || !file.Validate())
+		{
+			return false;
+		}
+		MakeNodes(file.GetGrid().columns, file.GetGrid().rows);
+		LoadMap(file);
+	}
+	else
+	{
+		MakeNodes(columns, rows);
+	}
+	if (!CreateMapTexture())
+	{
+		return false;
+	}
+
+	mSimulationRunning = true;
+	mSimulationThread = std::thread(&Pathfinding::SimulationLoop, this);
 	return true;
 }
 
+// Runs queries on the simulation thread until Shutdown, always against the newest world
+// published, so edits made while a search runs are picked up by the next one
+void Pathfinding::SimulationLoop()
+{
+	PathSearch search;
+	// Reused once the main thread has let go of them, like the world buffers
+	std::shared_ptr<PathSnapshot> pathBuffers[3];
+	unsigned int searchedVersion = 0;
+	// Only built while the landmark heuristic is selected, then again after every map edit
+	LandmarkTable landmarks;
+	unsigned int landmarksMapVersion = 0;
+	// Built for the configs it answers, then again after every map edit
+	SubgoalGraph subgoals;
+	bool subgoalsBuilt = false;
+	unsigned int subgoalsMapVersion = 0;
+
+	while (true)
+	{
+		std::shared_ptr<const WorldSnapshot> world;
+		{
+			std::unique_lock<std::mutex> lock(mSimulationMutex);
+			mSimulationWake.wait(lock, [&]() {
+				return !mSimulationRunning || (mLatestWorld && mLatestWorld->version != searchedVersion);
+			});
+			if (!mSimulationRunning)
+			{
+				return;
+			}
+			world = mLatestWorld;
+		}
+		searchedVersion = world->version;
+
+		std::shared_ptr<PathSnapshot> result;
+		for (std::shared_ptr<PathSnapshot>& buffer:pathBuffers)
+		{
+			if (!buffer)
+			{
+				buffer = std::make_shared<PathSnapshot>();
+			}
+			if (buffer.use_count() == 1)
+			{
+				result = buffer;
+				break;
+			}
+		}
+
+		GridView grid = { world->columns, world->rows, &world->walkableBits[0], &world->terrainCost[0], world->minTerrainCost, &world->clearance[0], nullptr, nullptr, nullptr, nullptr };
+		SearchConfig config = world->config;
+		// Searches during a paint stroke go without the derived tables, which are rebuilt once it ends
+		if (config.heuristic == HEURISTIC_LANDMARKS)
+		{
+			if (!world->editing && (landmarks.IsEmpty() || landmarksMapVersion != world->mapVersion))
+			{
+				landmarks.Build(grid, GLOBAL_CONST_EDITOR_LANDMARKS, LANDMARK_AVOID);
+				landmarksMapVersion = world->mapVersion;
+			}
+			if (!landmarks.IsEmpty() && landmarksMapVersion == world->mapVersion)
+			{
+				grid.landmarks = &landmarks;
+			}
+			else
+			{
+				// A stale table can overestimate once walls are erased
+				config.heuristic = HEURISTIC_OCTILE;
+			}
+		}
+		if (config.connectivity == EIGHT_CONNECTED && !config.cutCorners && config.mode == PATH_GRID &&
+			config.cost == COST_INT && config.agentSize == 1 && world->uniformTerrain)
+		{
+			if (!world->editing && (!subgoalsBuilt || subgoalsMapVersion != world->mapVersion))
+			{
+				subgoals.Build(grid, SUBGOAL_TWO_LEVEL);
+				subgoalsBuilt = true;
+				subgoalsMapVersion = world->mapVersion;
+			}
+			if (!subgoals.IsEmpty() && subgoalsMapVersion == world->mapVersion)
+			{
+				grid.subgoals = &subgoals;
+			}
+		}
+		result->found = search.FindPath(grid, world->start, world->target, config);
+		result->path.assign(search.GetPath().begin(), search.GetPath().end());
+		if (!result->found)
+		{
+			result->path.clear();
+		}
+		result->stats = search.GetStats();
+		result->trace.clear();
+		if (config.recordTrace)
+		{
+			search.GetTrace().CopyTo(result->trace);
+		}
+		result->version = world->version;
+
+		std::lock_guard<std::mutex> lock(mSimulationMutex);
+		mLatestPath = result;
+	}
+}
+
+// Copies the walls, terrain, endpoints and settings into a free snapshot buffer and hands it to the simulation thread.
+// A buffer keeps the map it was last filled with, so only the columns edited since then are copied again
+void Pathfinding::PublishWorld()
+{
+	std::shared_ptr<WorldSnapshot> world;
+	int index = 0;
+	for (; index < 3; index++)
+	{
+		if (!mWorldBuffers[index])
+		{
+			mWorldBuffers[index] = std::make_shared<WorldSnapshot>();
+		}
+		if (mWorldBuffers[index].use_count() == 1)
+		{
+			world = mWorldBuffers[index];
+			break;
+		}
+	}
+
+	if (world->columns != mColumns || world->rows != mRows || world->clearance.size() != mClearance.size())
+	{
+		world->walkableBits.assign(mWalkableBits.begin(), mWalkableBits.end());
+		world->terrainCost.assign(mTerrainCost.begin(), mTerrainCost.end());
+		world->clearance.assign(mClearance.begin(), mClearance.end());
+	}
+	else if (mWorldDirtyBegin[index] < mWorldDirtyEnd[index])
+	{
+		// Nodes are stored column by column, so the edited columns are one run of each array
+		const int begin = mWorldDirtyBegin[index] * mRows;
+		const int end = mWorldDirtyEnd[index] * mRows;
+		std::copy(mWalkableBits.begin() + (begin >> 3), mWalkableBits.begin() + ((end + 7) >> 3), world->walkableBits.begin() + (begin >> 3));
+		std::copy(mTerrainCost.begin() + begin, mTerrainCost.begin() + end, world->terrainCost.begin() + begin);
+		if (!mClearance.empty())
+		{
+			std::copy(mClearance.begin() + begin, mClearance.begin() + end, world->clearance.begin() + begin);
+		}
+	}
+	mWorldDirtyBegin[index] = 0;
+	mWorldDirtyEnd[index] = 0;
+
+	world->columns = mColumns;
+	world->rows = mRows;
+	world->minTerrainCost = GetMinTerrainCost();
+	world->start = mPathNodes.size() > 1 ? mPathNodes[0].GetId() : -1;
+	world->target = mPathNodes.size() > 1 ? mPathNodes[1].GetId() : -1;
+	world->config = mSearchConfig;
+	world->version = ++mWorldVersion;
+	world->mapVersion = mMapVersion;
+	world->editing = mMouseDown && mLeftMouseDown;
+	mPublishedEditing = world->editing;
+	world->uniformTerrain = mTerrainCostCount[GetMinTerrainCost()] == static_cast<int>(mTerrainCost.size());
+
+	{
+		std::lock_guard<std::mutex> lock(mSimulationMutex);
+		mLatestWorld = world;
+	}
+	mSimulationWake.notify_one();
+}
+
+void Pathfinding::MarkWorldDirty(int beginColumn, int endColumn)
+{
+	beginColumn = std::max(0, beginColumn);
+	endColumn = std::min(mColumns, endColumn);
+	for (int i = 0; i < 3; i++)
+	{
+		if (mWorldDirtyBegin[i] >= mWorldDirtyEnd[i])
+		{
+			mWorldDirtyBegin[i] = beginColumn;
+			mWorldDirtyEnd[i] = endColumn;
+		}
+		else
+		{
+			mWorldDirtyBegin[i] = std::min(mWorldDirtyBegin[i], beginColumn);
+			mWorldDirtyEnd[i] = std::max(mWorldDirtyEnd[i], endColumn);
+		}
+	}
+}
+
+// Takes the newest finished path, if any, without waiting for a search in progress
+void Pathfinding::ReceivePath()
+{
+	std::shared_ptr<const PathSnapshot> path;
+	{
+		std::lock_guard<std::mutex> lock(mSimulationMutex);
+		path.swap(mLatestPath);
+	}
+	if (!path)
+	{
+		return;
+	}
+
+	mPath.assign(path->path.begin(), path->path.end());
+	RebuildPathOverlay();
+	RebuildTraceLayer(path->trace);
+
+	// Queries without both endpoints are not searches
+	if (path->stats.findPathMs > 0.0)
+	{
+		mFindPathTiming.Add(path->stats.findPathMs);
+		mRetraceTiming.Add(path->stats.retraceMs);
+		mStatsHistory.push_back(path->stats);
+	}
+}
+
 // Runloop keeps running iterations of the pathfinding  until mIsRunning becomes false
 void Pathfinding::RunLoop()
 {
+	std::chrono::steady_clock::time_point frameBegin = std::chrono::steady_clock::now();
 	while (mIsRunning)
 	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 		ProcessInput();
+		mInputTiming.Add(GetElapsedMs(begin));
+
+		begin = std::chrono::steady_clock::now();
 		GenerateOutput();
+		mOutputTiming.Add(GetElapsedMs(begin));
+
+		mFrameTiming.Add(GetElapsedMs(frameBegin));
+		frameBegin = begin;
 	}
 }
 
 void Pathfinding::Shutdown()
 {
+	if (mSimulationThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mSimulationMutex);
+			mSimulationRunning = false;
+		}
+		mSimulationWake.notify_one();
+		mSimulationThread.join();
+	}
+
+	if (mGridTexture != nullptr)
+	{
+		SDL_DestroyTexture(mGridTexture);
+	}
+	if (mTraceTexture != nullptr)
+	{
+		SDL_DestroyTexture(mTraceTexture);
+	}
+	for (MapLevel& level:mMapLevels)
+	{
+		SDL_DestroyTexture(level.texture);
+	}
 	SDL_DestroyWindow(mWindow);
 	SDL_DestroyRenderer(mRenderer);
 	SDL_Quit();
@@ -184,11 +740,35 @@ void Pathfinding::ProcessInput()
 			mIsRunning = false;
 			break;
 
+			// Render target contents are lost on a device reset
+			case SDL_RENDER_TARGETS_RESET:
+			case SDL_RENDER_DEVICE_RESET:
+			mGridTextureDirty = true;
+			mMapDirtyRects.clear();
+			mMapDirtyRects.push_back(SDL_Rect{ 0, 0, mColumns, mRows });
+			break;
+
 			case SDL_MOUSEMOTION:
 			SDL_GetMouseState(&mXMouse,&mYMouse);
+			if (mMiddleMouseDown)
+			{
+				PanBy(-event.motion.xrel, -event.motion.yrel);
+			}
+			break;
+
+			case SDL_MOUSEWHEEL:
+			if (event.wheel.y != 0)
+			{
+				ZoomAt(mXMouse, mYMouse, std::pow(GLOBAL_CONST_ZOOM_STEP, static_cast<float>(event.wheel.y)));
+			}
 			break;
 
 			case SDL_MOUSEBUTTONDOWN:
+			if (event.button.button == SDL_BUTTON_MIDDLE)
+			{
+				mMiddleMouseDown = true;
+				break;
+			}
 			mMouseDown = true;
 			if (event.button.button  == SDL_BUTTON_RIGHT)
 			{
@@ -201,9 +781,118 @@ void Pathfinding::ProcessInput()
 			break;
 
 			case SDL_MOUSEBUTTONUP:
+			// The end of a paint stroke is published so the derived tables get rebuilt
+			mPathDirty = mPathDirty || mPublishedEditing;
 			mMouseDown = false;
 			mRightMouseDown = false;
 			mLeftMouseDown = false;
+			mMiddleMouseDown = false;
+			break;
+
+			// Search settings, FindPath dispatches to the matching kernel
+			case SDL_KEYDOWN:
+			if (event.key.repeat != 0)
+			{
+				break;
+			}
+			switch (event.key.keysym.scancode)
+			{
+				// Editor tools, W paints walls and the number keys pick a terrain brush
+				case SDL_SCANCODE_W:
+				mTerrainTool = false;
+				continue;
+
+				case SDL_SCANCODE_0:
+				SelectTerrainBrush(TERRAIN_GROUND);
+				continue;
+
+				case SDL_SCANCODE_1:
+				SelectTerrainBrush(TERRAIN_ROAD);
+				continue;
+
+				case SDL_SCANCODE_2:
+				SelectTerrainBrush(TERRAIN_MUD);
+				continue;
+
+				case SDL_SCANCODE_3:
+				SelectTerrainBrush(TERRAIN_WATER);
+				continue;
+
+				// View zoom around the window center
+				case SDL_SCANCODE_EQUALS:
+				ZoomAt(GLOBAL_CONST_WINDOW_WIDTH / 2, GLOBAL_CONST_WINDOW_HEIGHT / 2, GLOBAL_CONST_ZOOM_STEP);
+				continue;
+
+				case SDL_SCANCODE_MINUS:
+				ZoomAt(GLOBAL_CONST_WINDOW_WIDTH / 2, GLOBAL_CONST_WINDOW_HEIGHT / 2, 1.0f / GLOBAL_CONST_ZOOM_STEP);
+				continue;
+
+				case SDL_SCANCODE_T:
+				mShowOverlay = !mShowOverlay;
+				continue;
+
+				case SDL_SCANCODE_X:
+				ExportStats(GLOBAL_CONST_STATS_FILE);
+				continue;
+
+				case SDL_SCANCODE_F5:
+				SaveMap(mMapPath.c_str());
+				continue;
+
+				case SDL_SCANCODE_4:
+				mSearchConfig.connectivity = FOUR_CONNECTED;
+				break;
+
+				case SDL_SCANCODE_8:
+				mSearchConfig.connectivity = EIGHT_CONNECTED;
+				break;
+
+				case SDL_SCANCODE_C:
+				mSearchConfig.cutCorners = !mSearchConfig.cutCorners;
+				break;
+
+				case SDL_SCANCODE_A:
+				mSearchConfig.mode = static_cast<PathMode>((mSearchConfig.mode + 1) % PATH_MODE_COUNT);
+				break;
+
+				case SDL_SCANCODE_S:
+				mSearchConfig.smoothPath = !mSearchConfig.smoothPath;
+				break;
+
+				case SDL_SCANCODE_H:
+				mSearchConfig.heuristic = static_cast<HeuristicType>((mSearchConfig.heuristic + 1) % HEURISTIC_COUNT);
+				break;
+
+				case SDL_SCANCODE_F:
+				mSearchConfig.cost = mSearchConfig.cost == COST_INT ? COST_FLOAT : COST_INT;
+				break;
+
+				case SDL_SCANCODE_K:
+				mSearchConfig.agentSize = mSearchConfig.agentSize % GLOBAL_CONST_EDITOR_MAX_AGENT_SIZE + 1;
+				break;
+
+				case SDL_SCANCODE_V:
+#if PATHFINDING_SEARCH_TRACE
+				mSearchConfig.recordTrace = !mSearchConfig.recordTrace;
+				break;
+#else
+				SDL_Log("Search trace is compiled out");
+				continue;
+#endif
+
+				default:
+				continue;
+			}
+			SDL_Log("Search: %d-connected, corner cutting %s, path mode %d, smoothing %s, heuristic %d, %s costs, trace %s, agent size %d",
+				mSearchConfig.connectivity,
+				mSearchConfig.cutCorners ? "on" : "off",
+				mSearchConfig.mode,
+				mSearchConfig.smoothPath ? "on" : "off",
+				mSearchConfig.heuristic,
+				mSearchConfig.cost == COST_INT ? "int" : "float",
+				mSearchConfig.recordTrace ? "on" : "off",
+				mSearchConfig.agentSize);
+			mPathDirty = true;
 			break;
 		}
 	}
@@ -213,15 +902,19 @@ void Pathfinding::ProcessInput()
 		mIsRunning = false;
 	}
 	
-	if (state[SDL_SCANCODE_E])
+	// Arrow keys pan the view
+	float panX = (state[SDL_SCANCODE_RIGHT] ? 1.0f : 0.0f) - (state[SDL_SCANCODE_LEFT] ? 1.0f : 0.0f);
+	float panY = (state[SDL_SCANCODE_DOWN] ? 1.0f : 0.0f) - (state[SDL_SCANCODE_UP] ? 1.0f : 0.0f);
+	if (panX != 0.0f || panY != 0.0f)
 	{
-		mErase = true;
-	}
-	else
-	{ 
-		mErase = false;
+		PanBy(panX * GLOBAL_CONST_PAN_SPEED, panY * GLOBAL_CONST_PAN_SPEED);
 	}
 
+	// Holding E erases once, not on every frame
+	const bool eraseKeyDown = state[SDL_SCANCODE_E] != 0;
+	mErase = eraseKeyDown && !mEraseKeyDown;
+	mEraseKeyDown = eraseKeyDown;
+
 }
 
 void Pathfinding::GenerateOutput()
@@ -239,306 +932,879 @@ void Pathfinding::GenerateOutput()
 
 	SDL_SetRenderDrawBlendMode(mRenderer, SDL_BLENDMODE_BLEND);
 
-	SDL_SetRenderDrawColor(
-		mRenderer,
-		100,
-		101,
-		103,
-		150
-	);
-	
-	for ( auto node:mNodes)
-	{
-		if (node.GetRect()->x < mXMouse && (node.GetRect()->x + node.GetRect()->w) > mXMouse
-			&& node.GetRect()->y < mYMouse && (node.GetRect()->y + node.GetRect()->h) > mYMouse)
-		{
-
-			SDL_RenderFillRect(mRenderer, node.GetRect());
-		}
-
-	}
+	// Node under the cursor, shared by hovering, painting and endpoint selection
+	const int hoveredId = GetNodeAt(mXMouse, mYMouse);
 
-	if (mMouseDown == true && mLeftMouseDown == true)
+	if (mMouseDown == true && mLeftMouseDown == true && hoveredId >= 0)
 	{
-
-		for ( auto node:mNodes)
+		if (mTerrainTool)
 		{
-			if (node.GetRect()->x < mXMouse && (node.GetRect()->x + node.GetRect()->w) > mXMouse
-				&& node.GetRect()->y < mYMouse && (node.GetRect()->y + node.GetRect()->h) > mYMouse)
+			if (SetTerrainCost(hoveredId, mTerrainBrush))
 			{
-				auto iterator = std::find(mSelectedNodes.begin(), mSelectedNodes.end(), node);
-				if (iterator == mSelectedNodes.end())
-				{
-					node.walkable = false;
-					mSelectedNodes.push_back(node);
-				}
+				SetNodeTexel(hoveredId, GetNodeColor(hoveredId));
+				mPathDirty = true;
 			}
 		}
+		else if (mWalkable[hoveredId])
+		{
+			SetWalkable(hoveredId, false);
+			SetNodeTexel(hoveredId, GetNodeColor(hoveredId));
+			mPathDirty = true;
+		}
 	}
 
 	if (mErase == true)
 	{
-		mSelectedNodes.clear();
 		mPathNodes.clear();
 		mPath.clear();
+		mPathTexels.clear();
+		std::fill(mWalkable.begin(), mWalkable.end(), 1);
+		RebuildWalkability();
+		for (int id = 0; id < static_cast<int>(mTerrainCost.size()); id++)
+		{
+			SetTerrainCost(id, TERRAIN_GROUND);
+		}
+		RebuildMapPixels();
+		mPathDirty = true;
 	}
 
+	if (mRightMouseDown == true && hoveredId >= 0)
+	{
+		auto iterator = std::find(mPathNodes.begin(), mPathNodes.end(), mNodes[hoveredId]);
+		if (iterator == mPathNodes.end() && mPathNodes.size() < 2)
+		{
+			mPathNodes.push_back(mNodes[hoveredId]);
+			mPathDirty = true;
+		}
+	}
 
-	for (auto node:mSelectedNodes)
+	// The path shown stays the previous one until the simulation thread answers
+	if (mPathDirty)
 	{
-		
-		SDL_SetRenderDrawColor(
-					mRenderer,
-					255,
-					255,
-					255,
-					255
-				);
+		PublishWorld();
+		RebuildPathOverlay();
+		mPathDirty = false;
+	}
+	ReceivePath();
+
+	// Only the texels touched since the last frame are uploaded
+	UploadMapTexture();
+	DrawMap(GLOBAL_CONST_WINDOW_WIDTH, GLOBAL_CONST_WINDOW_HEIGHT);
+	DrawTraceLayer(GLOBAL_CONST_WINDOW_WIDTH, GLOBAL_CONST_WINDOW_HEIGHT);
+
+	SDL_SetRenderDrawColor(
+		mRenderer,
+		100,
+		101,
+		103,
+		150
+	);
 
-		SDL_RenderFillRect(mRenderer, node.GetRect());
+	if (hoveredId >= 0)
+	{
+		SDL_Point topLeft = GridToScreen(hoveredId / mRows, hoveredId % mRows);
+		SDL_Point bottomRight = GridToScreen(hoveredId / mRows + 1, hoveredId % mRows + 1);
+		SDL_Rect hovered{ topLeft.x, topLeft.y, bottomRight.x - topLeft.x, bottomRight.y - topLeft.y };
+		SDL_RenderFillRect(mRenderer, &hovered);
 	}
 
-	if (mRightMouseDown == true)
+	// Any-angle paths skip nodes, connect the waypoints through their centers
+	mPathPoints.clear();
+	if (mPathNodes.size() > 1)
+	{
+		for (int id:mPath)
 		{
+			mPathPoints.push_back(GridToScreen(id / mRows + 0.5f, id % mRows + 0.5f));
+		}
+	}
+	if (mPathPoints.size() > 1)
+	{
+		SDL_SetRenderDrawColor(mRenderer, 0, 255, 0, 255);
+		SDL_RenderDrawLines(mRenderer, &mPathPoints[0], mPathPoints.size());
+	}
 
-			for ( auto node:mNodes)
+	DrawGrid(mRenderer, GLOBAL_CONST_WINDOW_WIDTH,GLOBAL_CONST_WINDOW_HEIGHT);
+	if (mShowOverlay)
+	{
+		DrawOverlay(hoveredId);
+	}
+	// Swap the front and back buffers
+	SDL_RenderPresent(mRenderer);
+}
+
+// Rows of the 3x5 overlay font, top row first, bit 4 is the left column
+const char GLOBAL_CONST_FONT_CHARS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:%-/";
+const unsigned char GLOBAL_CONST_FONT_GLYPHS[][5] = {
+	{ 7, 5, 5, 5, 7 }, { 2, 6, 2, 2, 7 }, { 7, 1, 7, 4, 7 }, { 7, 1, 7, 1, 7 }, { 5, 5, 7, 1, 1 },
+	{ 7, 4, 7, 1, 7 }, { 7, 4, 7, 5, 7 }, { 7, 1, 1, 1, 1 }, { 7, 5, 7, 5, 7 }, { 7, 5, 7, 1, 7 },
+	{ 2, 5, 7, 5, 5 }, { 6, 5, 6, 5, 6 }, { 3, 4, 4, 4, 3 }, { 6, 5, 5, 5, 6 }, { 7, 4, 6, 4, 7 },
+	{ 7, 4, 6, 4, 4 }, { 3, 4, 5, 5, 3 }, { 5, 5, 7, 5, 5 }, { 7, 2, 2, 2, 7 }, { 1, 1, 1, 5, 2 },
+	{ 5, 5, 6, 5, 5 }, { 4, 4, 4, 4, 7 }, { 5, 7, 7, 5, 5 }, { 6, 5, 5, 5, 5 }, { 2, 5, 5, 5, 2 },
+	{ 6, 5, 6, 4, 4 }, { 2, 5, 5, 6, 3 }, { 6, 5, 6, 5, 5 }, { 3, 4, 2, 1, 6 }, { 7, 2, 2, 2, 2 },
+	{ 5, 5, 5, 5, 7 }, { 5, 5, 5, 5, 2 }, { 5, 5, 7, 7, 5 }, { 5, 5, 2, 5, 5 }, { 5, 5, 2, 2, 2 },
+	{ 7, 1, 2, 4, 7 }, { 0, 0, 0, 0, 2 }, { 0, 2, 0, 2, 0 }, { 5, 1, 2, 4, 5 }, { 0, 0, 7, 0, 0 },
+	{ 1, 1, 2, 4, 4 }
+};
+
+// Queues the font pixels of a line of text, characters missing from the font are left blank
+void Pathfinding::DrawText(int x, int y, const char* text)
+{
+	const int scale = GLOBAL_CONST_FONT_SCALE;
+	for (; *text != '\0'; text++, x += 4 * scale)
+	{
+		const char* found = std::strchr(GLOBAL_CONST_FONT_CHARS, std::toupper(static_cast<unsigned char>(*text)));
+		if (*text == ' ' || found == nullptr)
+		{
+			continue;
+		}
+		const unsigned char* glyph = GLOBAL_CONST_FONT_GLYPHS[found - GLOBAL_CONST_FONT_CHARS];
+		for (int row = 0; row < 5; row++)
+		{
+			for (int column = 0; column < 3; column++)
 			{
-				if (node.GetRect()->x < mXMouse && (node.GetRect()->x + node.GetRect()->w) > mXMouse
-					&& node.GetRect()->y < mYMouse && (node.GetRect()->y + node.GetRect()->h) > mYMouse)
+				if (glyph[row] & (4 >> column))
 				{
-					auto iterator = std::find(mPathNodes.begin(), mPathNodes.end(), node);
-					if (iterator == mPathNodes.end() && mPathNodes.size() < 2)
-					{
-						mPathNodes.push_back(node);
-					}
+					mOverlayRects.push_back(SDL_Rect{ x + column * scale, y + row * scale, scale, scale });
 				}
 			}
 		}
+	}
+}
 
-	for (auto node:mPathNodes)
+void Pathfinding::DrawTimingLine(int x, int y, const char* name, const TimingSeries& series)
+{
+	char line[96];
+	snprintf(line, sizeof(line), "%-9s AVG %6.2f P50 %6.2f P95 %6.2f P99 %6.2f",
+		name,
+		series.GetAverage(),
+		series.GetPercentile(0.5),
+		series.GetPercentile(0.95),
+		series.GetPercentile(0.99));
+	DrawText(x, y, line);
+}
+
+// Rolling timings in milliseconds over the last frames and queries, then the counters of the latest query
+void Pathfinding::DrawOverlay(int hoveredId)
+{
+	const int lineHeight = 7 * GLOBAL_CONST_FONT_SCALE;
+	const int x = 8;
+	int y = 8;
+	mOverlayRects.clear();
+
+	DrawText(x, y, "TIMINGS MS");
+	y += lineHeight;
+	DrawTimingLine(x, y, "FRAME", mFrameTiming);
+	y += lineHeight;
+	DrawTimingLine(x, y, "INPUT", mInputTiming);
+	y += lineHeight;
+	DrawTimingLine(x, y, "OUTPUT", mOutputTiming);
+	y += lineHeight;
+	DrawTimingLine(x, y, "FINDPATH", mFindPathTiming);
+	y += lineHeight;
+	DrawTimingLine(x, y, "RETRACE", mRetraceTiming);
+	y += lineHeight;
+
+	char line[96];
+	if (!mStatsHistory.empty())
 	{
-		
-		SDL_SetRenderDrawColor(
-					mRenderer,
-					255,
-					0,
-					0,
-					255
-				);
+		const SearchStats& stats = mStatsHistory.back();
+		snprintf(line, sizeof(line), "EXPANDED %d OPEN PEAK %d PATH %.1f", stats.nodesExpanded, stats.openPeak, stats.pathLength);
+	}
+	else
+	{
+		snprintf(line, sizeof(line), "NO QUERY YET");
+	}
+	DrawText(x, y, line);
+	y += lineHeight;
 
-		SDL_RenderFillRect(mRenderer, node.GetRect());
+	if (hoveredId >= 0 && mWallDistance.GetNearestWall(hoveredId) != GLOBAL_CONST_NO_WALL)
+	{
+		snprintf(line, sizeof(line), "WALL DISTANCE %.2f", mWallDistance.GetDistance(hoveredId));
+	}
+	else
+	{
+		snprintf(line, sizeof(line), "WALL DISTANCE -");
 	}
+	DrawText(x, y, line);
+	y += lineHeight;
+
+	// Wide enough for the timing lines, the longest ones
+	SDL_Rect background{ 0, 0, 2 * x + 53 * 4 * GLOBAL_CONST_FONT_SCALE, y + x - lineHeight + 5 * GLOBAL_CONST_FONT_SCALE };
+	SDL_SetRenderDrawColor(mRenderer, 0, 0, 0, 170);
+	SDL_RenderFillRect(mRenderer, &background);
+	SDL_SetRenderDrawColor(mRenderer, 230, 230, 230, 255);
+	if (!mOverlayRects.empty())
+	{
+		SDL_RenderFillRects(mRenderer, &mOverlayRects[0], mOverlayRects.size());
+	}
+}
 
-	if (mPathNodes.size() > 1)
+// Writes one row per query answered so far, for offline analysis
+bool Pathfinding::ExportStats(const char* path) const
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+	{
+		SDL_Log("Failed to open %s for writing", path);
+		return false;
+	}
+
+	fprintf(file, "query,find_path_ms,retrace_ms,nodes_expanded,open_peak,path_length\n");
+	for (size_t i = 0; i < mStatsHistory.size(); i++)
 	{
-		FindPath(mPathNodes[0], mPathNodes[1]);
+		const SearchStats& stats = mStatsHistory[i];
+		fprintf(file, "%zu,%.4f,%.4f,%d,%d,%.3f\n", i, stats.findPathMs, stats.retraceMs, stats.nodesExpanded, stats.openPeak, stats.pathLength);
 	}
+	fclose(file);
+	SDL_Log("Wrote %zu queries to %s", mStatsHistory.size(), path);
+	return true;
+}
+
+// Packs a color in the SDL_PIXELFORMAT_ARGB8888 layout of the map texture
+Uint32 PackColor(Uint8 r, Uint8 g, Uint8 b)
+{
+	return 0xff000000u | (static_cast<Uint32>(r) << 16) | (static_cast<Uint32>(g) << 8) | b;
+}
 
-	for (auto node:mPath)
+// The map is drawn from a texture with one texel per node, scaled up to the node size.
+// Halved levels down to a single texel serve as the overview when zoomed far out
+bool Pathfinding::CreateMapTexture()
+{
+	int width = mColumns;
+	int height = mRows;
+	while (true)
 	{
-		SDL_SetRenderDrawColor(
-					mRenderer,
-					0,
-					255,
-					0,
-					255
-				);
-		if ( std::find(mPathNodes.begin(), mPathNodes.end(), node) == mPathNodes.end() && mPathNodes.size() > 1)
+		MapLevel level;
+		level.width = width;
+		level.height = height;
+		level.pixels.assign(width * height, PackColor(12, 12, 13));
+		level.texture = SDL_CreateTexture(mRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+		if (!level.texture)
+		{
+			SDL_Log("Failed to create map texture: %s", SDL_GetError());
+			return false;
+		}
+		SDL_SetTextureScaleMode(level.texture, SDL_ScaleModeNearest);
+		mMapLevels.push_back(level);
+
+		if (width == 1 && height == 1)
 		{
-			SDL_RenderFillRect(mRenderer, node.GetRect());
+			break;
 		}
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
 	}
 
-	DrawGrid(mRenderer, GLOBAL_CONST_WINDOW_WIDTH,GLOBAL_CONST_WINDOW_HEIGHT);
-	// Swap the front and back buffers
-	SDL_RenderPresent(mRenderer);
+	RebuildMapPixels();
+	return true;
 }
 
-// Draws a grid of lines over the nodes at the end of generate output
-void Pathfinding::DrawGrid(SDL_Renderer* renderer, int windowWidth, int windowHeight)
+// Color of a node without the path on top, walls over terrain over the background
+Uint32 Pathfinding::GetNodeColor(int id) const
 {
+	if (!mWalkable[id])
+	{
+		return PackColor(255, 255, 255);
+	}
+	if (mTerrainCost[id] != TERRAIN_GROUND)
+	{
+		SDL_Color color = GetTerrainColor(mTerrainCost[id]);
+		return PackColor(color.r, color.g, color.b);
+	}
+	return PackColor(12, 12, 13);
+}
 
-		SDL_SetRenderDrawColor(
-		renderer,
-		100,
-		101,
-		103,
-		255
-	);
-	
-	for ( int i = 0; i < windowWidth; i += windowWidth * GLOBAL_CONST_GRID_SIZE)
+void Pathfinding::SetNodeTexel(int id, Uint32 color)
+{
+	const int x = id / mRows;
+	const int y = id % mRows;
+	Uint32& texel = mMapLevels[0].pixels[y * mColumns + x];
+	if (texel == color)
 	{
-		SDL_RenderDrawLine(renderer, i, 0, i, windowHeight);
-	} for ( int i = 0; i < windowHeight; i += windowHeight * GLOBAL_CONST_GRID_SIZE) { SDL_RenderDrawLine(renderer, 0, i, windowWidth, i); } }
+		return;
+	}
+	texel = color;
+	MarkMapDirty(SDL_Rect{ x, y, 1, 1 });
+}
 
-// Makes nodes row by row and assigns an ID to each node, node size is dependent on the window and the grid size
-void Pathfinding::MakeNodes(int windowWidth, int windowHeight)
+// Queues a region for upload, past GLOBAL_CONST_MAX_DIRTY_RECTS the regions merge into their bounding box
+void Pathfinding::MarkMapDirty(const SDL_Rect& rect)
 {
-	int id = 0;
-	for ( int i = 0; i < windowWidth; i += windowWidth * GLOBAL_CONST_GRID_SIZE)
+	if (mMapDirtyRects.size() < GLOBAL_CONST_MAX_DIRTY_RECTS)
 	{
-		for ( int j = 0; j < windowHeight; j += windowHeight * GLOBAL_CONST_GRID_SIZE)
-		{
-			SDL_Rect rect{i, j, static_cast<int>(windowWidth * GLOBAL_CONST_GRID_SIZE), static_cast<int>(windowHeight * GLOBAL_CONST_GRID_SIZE)};
-			auto node = new Node(rect, id);
-			mNodes.push_back(*node);
-			id++;
-		}
+		mMapDirtyRects.push_back(rect);
+		return;
 	}
+
+	SDL_Rect bounds = rect;
+	for (const SDL_Rect& dirty:mMapDirtyRects)
+	{
+		SDL_UnionRect(&bounds, &dirty, &bounds);
+	}
+	mMapDirtyRects.clear();
+	mMapDirtyRects.push_back(bounds);
 }
 
-// Basic implementation of the A* pathfinding algorithm
-void Pathfinding::FindPath(Node start, Node target)
+// Recomputes every texel, used when the whole map changes at once
+void Pathfinding::RebuildMapPixels()
 {
-	std::vector<Node> openSet;
-	std::vector<Node> closedSet;
+	std::vector<Uint32>& pixels = mMapLevels[0].pixels;
+	for (int id = 0; id < static_cast<int>(mNodes.size()); id++)
+	{
+		pixels[(id % mRows) * mColumns + id / mRows] = GetNodeColor(id);
+	}
+	for (int id:mPathTexels)
+	{
+		pixels[(id % mRows) * mColumns + id / mRows] = PackColor(0, 255, 0);
+	}
+	for (auto node:mPathNodes)
+	{
+		pixels[(node.GetId() % mRows) * mColumns + node.GetId() / mRows] = PackColor(255, 0, 0);
+	}
 
-	openSet.push_back(start);
+	mMapDirtyRects.clear();
+	mMapDirtyRects.push_back(SDL_Rect{ 0, 0, mColumns, mRows });
+}
 
-	while (openSet.size() > 0)
+void Pathfinding::UploadMapTexture()
+{
+	for (const SDL_Rect& dirty:mMapDirtyRects)
 	{
-		Node currentNode = openSet[0];
-		for (int i = 1; i < openSet.size(); i++)
+		SDL_Rect rect = dirty;
+		for (int level = 0; level < static_cast<int>(mMapLevels.size()); level++)
 		{
-			if (openSet[i].fCost() < currentNode.fCost() || openSet[i].fCost() == currentNode.fCost() && openSet[i].hCost < currentNode.hCost)
+			if (level > 0)
 			{
-				currentNode = openSet[i];
+				// Texels of this level covering the dirty texels of the level below
+				int right = (rect.x + rect.w - 1) / 2;
+				int bottom = (rect.y + rect.h - 1) / 2;
+				rect.x /= 2;
+				rect.y /= 2;
+				rect.w = right - rect.x + 1;
+				rect.h = bottom - rect.y + 1;
+				AggregateMapLevel(level, rect);
 			}
-		}
-		// openSet remove current node
-		auto iterator = std::find(openSet.begin(), openSet.end(), currentNode);
-		if (iterator != openSet.end())
-		{
-			openSet.erase(iterator);
-		}
-		// closedSet add current node
-		closedSet.push_back(currentNode);
 
-		if (currentNode == target)
-		{
-			target.parent = currentNode.parent;
-			RetracePath(start, target);
-			
-			return;
+			MapLevel& map = mMapLevels[level];
+			SDL_UpdateTexture(map.texture, &rect, &map.pixels[rect.y * map.width + rect.x], map.width * sizeof(Uint32));
 		}
+	}
+	mMapDirtyRects.clear();
+}
 
-		for (Node neighbor:GetNeighbors(currentNode))
+// Recomputes a region of a pyramid level from the level below, taking the brightest
+// of each channel so single walls and path nodes stay visible in the overview
+void Pathfinding::AggregateMapLevel(int level, const SDL_Rect& rect)
+{
+	const MapLevel& source = mMapLevels[level - 1];
+	MapLevel& map = mMapLevels[level];
+	for (int y = rect.y; y < rect.y + rect.h; y++)
+	{
+		for (int x = rect.x; x < rect.x + rect.w; x++)
 		{
-			if (/*!neighbor.walkable*/ std::find(mSelectedNodes.begin(), mSelectedNodes.end(), neighbor) != mSelectedNodes.end()|| 
-				std::find(closedSet.begin(), closedSet.end(), neighbor) != closedSet.end())
-			{
-				continue;
-			}
-
-			int newMovementCostToNeighbor = currentNode.gCost + GetDistance(currentNode, neighbor);
-
-			if (newMovementCostToNeighbor < neighbor.gCost || std::find(openSet.begin(), openSet.end(), neighbor) == openSet.end())
+			Uint32 red = 0;
+			Uint32 green = 0;
+			Uint32 blue = 0;
+			for (int sourceY = 2 * y; sourceY < std::min(2 * y + 2, source.height); sourceY++)
 			{
-				neighbor.gCost = newMovementCostToNeighbor;
-				neighbor.hCost = GetDistance(neighbor, target);
-				neighbor.parent.push_back(currentNode);
-
-				if (std::find(openSet.begin(), openSet.end(), neighbor) == openSet.end())
+				for (int sourceX = 2 * x; sourceX < std::min(2 * x + 2, source.width); sourceX++)
 				{
-					openSet.push_back(neighbor);
+					Uint32 texel = source.pixels[sourceY * source.width + sourceX];
+					red = std::max(red, texel & 0x00ff0000u);
+					green = std::max(green, texel & 0x0000ff00u);
+					blue = std::max(blue, texel & 0x000000ffu);
 				}
-
 			}
+			map.pixels[y * map.width + x] = 0xff000000u | red | green | blue;
 		}
 	}
 }
 
-// Used to draw the shortest path after find path completes (if a path is available)
-void Pathfinding::RetracePath(Node start, Node target)
+// Draws the part of the map inside the window, from the pyramid level whose
+// texels are closest to one screen pixel once nodes get smaller than that
+void Pathfinding::DrawMap(int windowWidth, int windowHeight)
 {
-	std::vector<Node> path;
-	Node currentNode = target;
-	Node tmp = target;
+	const float nodeWidth = GetViewNodeWidth();
+	const float nodeHeight = GetViewNodeHeight();
+	int level = 0;
+	while (level + 1 < static_cast<int>(mMapLevels.size()) && nodeWidth * (1 << (level + 1)) <= 1.0f && nodeHeight * (1 << (level + 1)) <= 1.0f)
+	{
+		level++;
+	}
+	const MapLevel& map = mMapLevels[level];
+	SDL_Rect source;
+	SDL_Rect destination;
+	if (GetVisibleTexels(windowWidth, windowHeight, 1 << level, map.width, map.height, source, destination))
+	{
+		SDL_RenderCopy(mRenderer, map.texture, &source, &destination);
+	}
+}
 
-	while (currentNode != start)
+bool Pathfinding::GetVisibleTexels(int windowWidth, int windowHeight, int scale, int width, int height, SDL_Rect& source, SDL_Rect& destination) const
+{
+	const float nodeWidth = GetViewNodeWidth();
+	const float nodeHeight = GetViewNodeHeight();
+
+	// Visible nodes, rounded out to whole texels of the level
+	int firstColumn = std::max(0, static_cast<int>(std::floor(mCamera.x)));
+	int firstRow = std::max(0, static_cast<int>(std::floor(mCamera.y)));
+	int lastColumn = std::min(mColumns, static_cast<int>(std::ceil(mCamera.x + windowWidth / nodeWidth)));
+	int lastRow = std::min(mRows, static_cast<int>(std::ceil(mCamera.y + windowHeight / nodeHeight)));
+	if (firstColumn >= lastColumn || firstRow >= lastRow)
 	{
+		return false;
+	}
+
+	source.x = firstColumn / scale;
+	source.y = firstRow / scale;
+	source.w = std::min(width, (lastColumn + scale - 1) / scale) - source.x;
+	source.h = std::min(height, (lastRow + scale - 1) / scale) - source.y;
 
-		path.push_back(currentNode);
-		if (currentNode.parent.size() != 0)
+	SDL_Point topLeft = GridToScreen(source.x * scale, source.y * scale);
+	SDL_Point bottomRight = GridToScreen((source.x + source.w) * scale, (source.y + source.h) * scale);
+	destination = SDL_Rect{ topLeft.x, topLeft.y, bottomRight.x - topLeft.x, bottomRight.y - topLeft.y };
+	return true;
+}
+
+// Closed nodes are shaded by expansion order, nodes left open are a dim green.
+// The whole layer is one texture so it draws in a single copy however large the search was
+void Pathfinding::RebuildTraceLayer(const std::vector<unsigned int>& trace)
+{
+	mShowTrace = !trace.empty();
+	if (!mShowTrace)
+	{
+		return;
+	}
+
+	if (mTraceTexture == nullptr)
+	{
+		mTraceTexture = SDL_CreateTexture(mRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, mColumns, mRows);
+		if (mTraceTexture == nullptr)
 		{
-			tmp = currentNode.parent[0];
+			SDL_Log("Failed to create trace texture: %s", SDL_GetError());
+			mShowTrace = false;
+			return;
 		}
+		SDL_SetTextureBlendMode(mTraceTexture, SDL_BLENDMODE_BLEND);
+		SDL_SetTextureScaleMode(mTraceTexture, SDL_ScaleModeNearest);
+	}
 
-		currentNode = tmp;
+	int closedCount = 0;
+	for (unsigned int event:trace)
+	{
+		closedCount += event & 1;
 	}
 
-	std::reverse(path.begin(), path.end());
-	mPath = path;
+	mTracePixels.assign(mColumns * mRows, 0);
+	int order = 0;
+	for (unsigned int event:trace)
+	{
+		const int id = static_cast<int>(event >> 1);
+		// The texture is stored row by row, node ids run column by column
+		Uint32& texel = mTracePixels[(id % mRows) * mColumns + id / mRows];
+		if (event & 1)
+		{
+			Uint32 heat = static_cast<Uint32>(255 * order / std::max(1, closedCount - 1));
+			texel = 0x96000000u | (heat << 16) | (0x50u << 8) | (255 - heat);
+			order++;
+		}
+		else if (texel == 0)
+		{
+			texel = 0x6e3cdc5au;
+		}
+	}
+	SDL_UpdateTexture(mTraceTexture, nullptr, &mTracePixels[0], mColumns * sizeof(Uint32));
 }
 
-// Used within the A* algorithm to get the surrounding nodes of the current node being analyzed
-std::vector<Node> Pathfinding::GetNeighbors(Node currentNode)
+void Pathfinding::DrawTraceLayer(int windowWidth, int windowHeight)
 {
-	std::vector<Node> neighbors;
-	for (auto node:mNodes)
+	SDL_Rect source;
+	SDL_Rect destination;
+	if (mShowTrace && GetVisibleTexels(windowWidth, windowHeight, 1, mColumns, mRows, source, destination))
 	{
-		if (node.GetPosition().x == currentNode.GetPosition().x && node.GetPosition().y == currentNode.GetPosition().y)
-		{
-			continue;
-		}
+		SDL_RenderCopy(mRenderer, mTraceTexture, &source, &destination);
+	}
+}
 
-		if (node.GetPosition().x > 0 && node.GetPosition().x < GLOBAL_CONST_WINDOW_WIDTH && 
-			node.GetPosition().x > (currentNode.GetPosition().x - (GLOBAL_CONST_WINDOW_WIDTH*GLOBAL_CONST_GRID_SIZE+GLOBAL_CONST_WINDOW_WIDTH*0.015)) &&
-			node.GetPosition().x < (currentNode.GetPosition().x + (GLOBAL_CONST_WINDOW_WIDTH*GLOBAL_CONST_GRID_SIZE+GLOBAL_CONST_WINDOW_WIDTH*0.015)) &&
-			node.GetPosition().y >= 0 && node.GetPosition().y < GLOBAL_CONST_WINDOW_HEIGHT &&
-			node.GetPosition().y > (currentNode.GetPosition().y - (GLOBAL_CONST_WINDOW_HEIGHT*GLOBAL_CONST_GRID_SIZE+GLOBAL_CONST_WINDOW_WIDTH*0.015)) &&
-			node.GetPosition().y < (currentNode.GetPosition().y + (GLOBAL_CONST_WINDOW_HEIGHT*GLOBAL_CONST_GRID_SIZE+GLOBAL_CONST_WINDOW_WIDTH*0.015)))
+SDL_Point Pathfinding::GridToScreen(float column, float row) const
+{
+	const float nodeWidth = GetViewNodeWidth();
+	const float nodeHeight = GetViewNodeHeight();
+	// Rounded separately so every layer lines up with the grid lines
+	const int originX = -static_cast<int>(std::floor(mCamera.x * nodeWidth + 0.5f));
+	const int originY = -static_cast<int>(std::floor(mCamera.y * nodeHeight + 0.5f));
+	return SDL_Point{ originX + static_cast<int>(std::floor(column * nodeWidth + 0.5f)), originY + static_cast<int>(std::floor(row * nodeHeight + 0.5f)) };
+}
 
+// Moves the view by a distance in window pixels, keeping at least part of the map in sight
+void Pathfinding::PanBy(float dx, float dy)
+{
+	const float viewColumns = GLOBAL_CONST_WINDOW_WIDTH / GetViewNodeWidth();
+	const float viewRows = GLOBAL_CONST_WINDOW_HEIGHT / GetViewNodeHeight();
+	mCamera.x = std::max(-viewColumns / 2, std::min(mColumns - viewColumns / 2, mCamera.x + dx / GetViewNodeWidth()));
+	mCamera.y = std::max(-viewRows / 2, std::min(mRows - viewRows / 2, mCamera.y + dy / GetViewNodeHeight()));
+}
+
+// Zooms keeping the node under the given window position in place. Zooming out
+// stops once the whole map takes up half of the window
+void Pathfinding::ZoomAt(int x, int y, float factor)
+{
+	const float fitZoom = std::min(
+		GLOBAL_CONST_WINDOW_WIDTH / static_cast<float>(mColumns * mNodeWidth),
+		GLOBAL_CONST_WINDOW_HEIGHT / static_cast<float>(mRows * mNodeHeight));
+	const float minZoom = std::min(1.0f, fitZoom / 2);
+	const float zoom = std::max(minZoom, std::min(GLOBAL_CONST_MAX_ZOOM, mCamera.zoom * factor));
+
+	const float anchorX = mCamera.x + x / GetViewNodeWidth();
+	const float anchorY = mCamera.y + y / GetViewNodeHeight();
+	mCamera.zoom = zoom;
+	mCamera.x = anchorX - x / GetViewNodeWidth();
+	mCamera.y = anchorY - y / GetViewNodeHeight();
+	PanBy(0.0f, 0.0f);
+}
+
+// Swaps the previous path and endpoints out of the map texture for the current ones, runs after each search
+void Pathfinding::RebuildPathOverlay()
+{
+	for (int id:mPathTexels)
+	{
+		SetNodeTexel(id, GetNodeColor(id));
+	}
+	mPathTexels.clear();
+
+	if (mPathNodes.size() > 1)
+	{
+		for (int id:mPath)
 		{
-			neighbors.push_back(node);
+			mPathTexels.push_back(id);
+			SetNodeTexel(id, PackColor(0, 255, 0));
 		}
 	}
-	
-	return neighbors;
+
+	for (auto node:mPathNodes)
+	{
+		mPathTexels.push_back(node.GetId());
+		SetNodeTexel(node.GetId(), PackColor(255, 0, 0));
+	}
 }
 
-// Used within the A* algorithm to calculate distance between selected nodes
-int Pathfinding::GetDistance(Node nodeA, Node nodeB)
+// Draws a grid of lines over the nodes at the end of generate output
+void Pathfinding::DrawGrid(SDL_Renderer* renderer, int windowWidth, int windowHeight)
 {
-	int distanceX = std::abs(nodeA.GetPosition().x - nodeB.GetPosition().x);
-	int distanceY = std::abs(nodeA.GetPosition().y - nodeB.GetPosition().y);
+	const float nodeWidth = GetViewNodeWidth();
+	const float nodeHeight = GetViewNodeHeight();
+	// Lines this dense would only darken the map
+	if (nodeWidth < GLOBAL_CONST_MIN_GRID_LINE_SPACING || nodeHeight < GLOBAL_CONST_MIN_GRID_LINE_SPACING)
+	{
+		return;
+	}
+
+	const int gridWidth = static_cast<int>(std::floor(mColumns * nodeWidth + 0.5f));
+	const int gridHeight = static_cast<int>(std::floor(mRows * nodeHeight + 0.5f));
+	if (mGridTextureDirty || mGridTextureZoom != mCamera.zoom || mGridTextureColumns != mColumns || mGridTextureRows != mRows)
+	{
+		RenderGridTexture(renderer, gridWidth, gridHeight);
+	}
+
+	// Where the top left of the grid lands in the window
+	SDL_Point origin = GridToScreen(0.0f, 0.0f);
+	SDL_Rect view{ -origin.x, -origin.y, windowWidth, windowHeight };
+	SDL_Rect grid{ 0, 0, gridWidth, gridHeight };
+	SDL_Rect visible;
+	if (!SDL_IntersectRect(&view, &grid, &visible))
+	{
+		return;
+	}
 
-	if (distanceX > distanceY)
+	if (mGridTexture != nullptr)
 	{
-		return 14*distanceY + 10*(distanceX-distanceY);
+		SDL_Rect destination{ visible.x + origin.x, visible.y + origin.y, visible.w, visible.h };
+		SDL_RenderCopy(renderer, mGridTexture, &visible, &destination);
 	}
 	else
 	{
-		return 14*distanceX + 10*(distanceY-distanceX);
+		DrawGridLines(renderer, visible, origin.x, origin.y);
 	}
 }
 
-	
-int main(int argc, char** argv)
+// Renders the whole grid overlay at the current zoom into mGridTexture, which stays
+// null when the renderer has no render targets or the grid is too big for one texture
+void Pathfinding::RenderGridTexture(SDL_Renderer* renderer, int gridWidth, int gridHeight)
 {
-	Pathfinding pathfinding;
-	bool success = pathfinding.Initialize();
-	if (success)
+	if (mGridTexture != nullptr)
 	{
-		pathfinding.RunLoop();
+		SDL_DestroyTexture(mGridTexture);
+		mGridTexture = nullptr;
 	}
-	pathfinding.Shutdown(); 
-	return 0;
+	mGridTextureDirty = false;
+	mGridTextureZoom = mCamera.zoom;
+	mGridTextureColumns = mColumns;
+	mGridTextureRows = mRows;
+
+	SDL_RendererInfo info;
+	if (SDL_GetRendererInfo(renderer, &info) != 0 || !SDL_RenderTargetSupported(renderer))
+	{
+		return;
+	}
+	int maxWidth = info.max_texture_width > 0 ? std::min(info.max_texture_width, GLOBAL_CONST_MAX_GRID_TEXTURE_SIZE) : GLOBAL_CONST_MAX_GRID_TEXTURE_SIZE;
+	int maxHeight = info.max_texture_height > 0 ? std::min(info.max_texture_height, GLOBAL_CONST_MAX_GRID_TEXTURE_SIZE) : GLOBAL_CONST_MAX_GRID_TEXTURE_SIZE;
+	if (gridWidth <= 0 || gridHeight <= 0 || gridWidth > maxWidth || gridHeight > maxHeight)
+	{
+		return;
+	}
+
+	mGridTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, gridWidth, gridHeight);
+	if (mGridTexture == nullptr)
+	{
+		SDL_Log("Failed to create grid texture: %s", SDL_GetError());
+		return;
+	}
+	SDL_SetTextureBlendMode(mGridTexture, SDL_BLENDMODE_BLEND);
+
+	SDL_SetRenderTarget(renderer, mGridTexture);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+	SDL_RenderClear(renderer);
+	SDL_Rect all{ 0, 0, gridWidth, gridHeight };
+	DrawGridLines(renderer, all, 0, 0);
+	SDL_SetRenderTarget(renderer, nullptr);
 }
 
+// Draws only the grid lines inside an area given in zoomed grid pixels, the origin is where the top left of the grid lands on the target
+void Pathfinding::DrawGridLines(SDL_Renderer* renderer, const SDL_Rect& area, int originX, int originY)
+{
+	SDL_SetRenderDrawColor(
+		renderer,
+		100,
+		101,
+		103,
+		255
+	);
 
+	const float nodeWidth = GetViewNodeWidth();
+	const float nodeHeight = GetViewNodeHeight();
 
+	const int firstColumn = std::max(0, static_cast<int>(std::ceil(area.x / nodeWidth)));
+	const int lastColumn = std::min(mColumns - 1, static_cast<int>((area.x + area.w - 1) / nodeWidth));
+	for (int column = firstColumn; column <= lastColumn; column++)
+	{
+		int x = originX + static_cast<int>(std::floor(column * nodeWidth + 0.5f));
+		SDL_RenderDrawLine(renderer, x, originY + area.y, x, originY + area.y + area.h - 1);
+	}
 
+	const int firstRow = std::max(0, static_cast<int>(std::ceil(area.y / nodeHeight)));
+	const int lastRow = std::min(mRows - 1, static_cast<int>((area.y + area.h - 1) / nodeHeight));
+	for (int row = firstRow; row <= lastRow; row++)
+	{
+		int y = originY + static_cast<int>(std::floor(row * nodeHeight + 0.5f));
+		SDL_RenderDrawLine(renderer, originX + area.x, y, originX + area.x + area.w - 1, y);
+	}
+}
 
+// Makes nodes column by column and assigns an ID to each node, node size is dependent on the window and the grid size
+void Pathfinding::MakeNodes(int columns, int rows)
+{
+	int id = 0;
+	mColumns = columns;
+	mRows = rows;
+	mNodeWidth = static_cast<int>(GLOBAL_CONST_WINDOW_WIDTH * GLOBAL_CONST_GRID_SIZE);
+	mNodeHeight = static_cast<int>(GLOBAL_CONST_WINDOW_HEIGHT * GLOBAL_CONST_GRID_SIZE);
+	mNodes.reserve(columns * rows);
+	for (int i = 0; i < columns; i++)
+	{
+		for (int j = 0; j < rows; j++)
+		{
+			SDL_Rect rect{i * mNodeWidth, j * mNodeHeight, mNodeWidth, mNodeHeight};
+			mNodes.push_back(Node(rect, id));
+			id++;
+		}
+	}
 
+	mWalkable.assign(mNodes.size(), 1);
+	mTerrainCost.assign(mNodes.size(), TERRAIN_GROUND);
+	std::fill(mTerrainCostCount, mTerrainCostCount + 256, 0);
+	mTerrainCostCount[TERRAIN_GROUND] = mNodes.size();
+	RebuildWalkability();
+}
 
+void Pathfinding::LoadMap(const MapFile& file)
+{
+	const GridView grid = file.GetGrid();
+	for (int id = 0; id < static_cast<int>(mWalkable.size()); id++)
+	{
+		mWalkable[id] = (grid.walkableBits[id >> 3] >> (id & 7)) & 1;
+	}
+	RebuildWalkability();
 
+	if (grid.terrainCost != nullptr)
+	{
+		mTerrainCost.assign(grid.terrainCost, grid.terrainCost + mTerrainCost.size());
+		std::fill(mTerrainCostCount, mTerrainCostCount + 256, 0);
+		for (unsigned char cost:mTerrainCost)
+		{
+			mTerrainCostCount[cost]++;
+		}
+	}
+	mPathDirty = true;
+}
 
+// Terrain is left out while every node is plain ground
+bool Pathfinding::SaveMap(const char* path) const
+{
+	GridView grid = GetGridView();
+	if (mTerrainCostCount[TERRAIN_GROUND] == static_cast<int>(mTerrainCost.size()))
+	{
+		grid.terrainCost = nullptr;
+	}
+	if (!MapFile::Write(path, grid, std::vector<MapSectionData>()))
+	{
+		return false;
+	}
+	SDL_Log("Saved map to %s", path);
+	return true;
+}
+
+int Pathfinding::GetNodeAt(int x, int y) const
+{
+	if (x < 0 || y < 0)
+	{
+		return -1;
+	}
+
+	SDL_Point origin = GridToScreen(0.0f, 0.0f);
+	const int column = static_cast<int>(std::floor((x - origin.x) / GetViewNodeWidth()));
+	const int row = static_cast<int>(std::floor((y - origin.y) / GetViewNodeHeight()));
+	if (column < 0 || row < 0 || column >= mColumns || row >= mRows)
+	{
+		return -1;
+	}
+	return GetCellId(column, row);
+}
+
+bool Pathfinding::SetTerrainCost(int id, unsigned char cost)
+{
+	// Zero would make nodes free and break the heuristic scaling
+	if (cost == 0)
+	{
+		cost = 1;
+	}
+	if (mTerrainCost[id] == cost)
+	{
+		return false;
+	}
+	mTerrainCostCount[mTerrainCost[id]]--;
+	mTerrainCostCount[cost]++;
+	mTerrainCost[id] = cost;
+	MarkWorldDirty(id / mRows, id / mRows + 1);
+	mMapVersion++;
+	return true;
+}
+
+void Pathfinding::SetWalkable(int id, bool walkable)
+{
+	mWalkable[id] = walkable;
+	const unsigned char bit = static_cast<unsigned char>(1 << (id & 7));
+	mWalkableBits[id >> 3] = walkable ? mWalkableBits[id >> 3] | bit : mWalkableBits[id >> 3] & ~bit;
+	UpdateClearance(GetGridView(), id / mRows, id % mRows, mClearance);
+	// The clearance of the columns to the left changes along with it
+	MarkWorldDirty(id / mRows - GLOBAL_CONST_MAX_AGENT_SIZE + 1, id / mRows + 1);
+	mWallDistance.SetWall(id, !walkable);
+	mWallDistance.Update();
+	mMapVersion++;
+}
+
+void Pathfinding::RebuildWalkability()
+{
+	PackWalkableBits(mWalkable, mWalkableBits);
+	ComputeClearance(GetGridView(), mClearance);
+	mWallDistance.Reset(GetGridView());
+	MarkWorldDirty(0, mColumns);
+	mMapVersion++;
+}
+
+// The editor's grid as the search sees it, valid until the next edit
+GridView Pathfinding::GetGridView() const
+{
+	GridView grid;
+	grid.columns = mColumns;
+	grid.rows = mRows;
+	grid.walkableBits = &mWalkableBits[0];
+	grid.terrainCost = &mTerrainCost[0];
+	grid.minTerrainCost = GetMinTerrainCost();
+	grid.clearance = mClearance.empty() ? nullptr : &mClearance[0];
+	grid.landmarks = nullptr;
+	grid.contraction = nullptr;
+	grid.pathDatabase = nullptr;
+	grid.subgoals = nullptr;
+	return grid;
+}
 
+int Pathfinding::GetMinTerrainCost() const
+{
+	for (int cost = 1; cost < 256; cost++)
+	{
+		if (mTerrainCostCount[cost] > 0)
+		{
+			return cost;
+		}
+	}
+	return 1;
+}
 
+// Terrain presets get their own colors, other costs are shaded by weight
+SDL_Color Pathfinding::GetTerrainColor(unsigned char cost) const
+{
+	switch (cost)
+	{
+		case TERRAIN_ROAD:
+		return SDL_Color{ 140, 120, 90, 255 };
 
+		case TERRAIN_MUD:
+		return SDL_Color{ 90, 60, 35, 255 };
 
+		case TERRAIN_WATER:
+		return SDL_Color{ 30, 70, 150, 255 };
 
+		default:
+		Uint8 shade = static_cast<Uint8>(std::min(255, 40 + cost));
+		return SDL_Color{ shade, shade, 40, 255 };
+	}
+}
 
+void Pathfinding::SelectTerrainBrush(unsigned char cost)
+{
+	mTerrainTool = true;
+	mTerrainBrush = cost;
+	SDL_Log("Terrain brush: cost %d", cost);
+}
 
+	
+int main(int argc, char** argv)
+{
+	// Usage: output [columns rows] [map], the default grid fills the window.
+	// An existing map keeps its own size
+	int columns = static_cast<int>(1 / GLOBAL_CONST_GRID_SIZE + 0.5f);
+	int rows = columns;
+	const char* mapPath = nullptr;
+	if (argc == 2)
+	{
+		mapPath = argv[1];
+	}
+	if (argc >= 3)
+	{
+		columns = std::max(1, std::atoi(argv[1]));
+		rows = std::max(1, std::atoi(argv[2]));
+	}
+	if (argc >= 4)
+	{
+		mapPath = argv[3];
+	}
 
+	Pathfinding pathfinding;
+	bool success = pathfinding.Initialize(columns, rows, mapPath);
+	if (success)
+	{
+		pathfinding.RunLoop();
+	}
+	pathfinding.Shutdown(); 
+	return 0;
+}
@@ -0,0 +1,401 @@
+#include "path_database.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+// Position of x, y along the Hilbert curve filling a side by side square, side a power of two
+static uint64_t GetHilbertIndex(uint32_t side, uint32_t x, uint32_t y)
+{
+	uint64_t index = 0;
+	for (uint32_t half = side / 2; half > 0; half /= 2)
+	{
+		const uint32_t rx = (x & half) != 0 ? 1 : 0;
+		const uint32_t ry = (y & half) != 0 ? 1 : 0;
+		index += static_cast<uint64_t>(half) * half * ((3 * rx) ^ ry);
+		// Rotates the quadrant so the curve inside it starts where the last one ended
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = side - 1 - x;
+				y = side - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return index;
+}
+
+PathDatabase::PathDatabase()
+{
+	std::memset(&mHeader, 0, sizeof(mHeader));
+	mOrderIndex = nullptr;
+	mComponent = nullptr;
+	mFirstRun = nullptr;
+	mRuns = nullptr;
+	mStats = PathDatabaseStats();
+}
+
+bool PathDatabase::Build(const GridView& grid, const SearchConfig& config, TargetOrder order, int threadCount)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	mStats = PathDatabaseStats();
+	threadCount = std::max(1, threadCount);
+	const int nodeCount = grid.columns * grid.rows;
+	if (nodeCount >= GLOBAL_CONST_MAX_DATABASE_NODES)
+	{
+		PathfindingLog("A path database holds at most %d nodes, the map has %d", GLOBAL_CONST_MAX_DATABASE_NODES - 1, nodeCount);
+		return false;
+	}
+
+	// Components, and the depth first order along the way
+	std::vector<int> depthFirst;
+	std::vector<int> stack;
+	mOwnedComponent.assign(nodeCount, GLOBAL_CONST_NO_COMPONENT);
+	uint32_t componentCount = 0;
+	for (int id = 0; id < nodeCount; id++)
+	{
+		if (!grid.IsWalkable(id / grid.rows, id % grid.rows) || mOwnedComponent[id] != GLOBAL_CONST_NO_COMPONENT)
+		{
+			continue;
+		}
+		stack.push_back(id);
+		while (!stack.empty())
+		{
+			const int node = stack.back();
+			stack.pop_back();
+			if (mOwnedComponent[node] != GLOBAL_CONST_NO_COMPONENT)
+			{
+				continue;
+			}
+			mOwnedComponent[node] = componentCount;
+			depthFirst.push_back(node);
+			const int x = node / grid.rows;
+			const int y = node % grid.rows;
+			for (int i = 0; i < config.connectivity; i++)
+			{
+				if (!grid.CanStep(x, y, x + offsetX[i], y + offsetY[i], config.cutCorners))
+				{
+					continue;
+				}
+				const int neighbor = grid.GetCellId(x + offsetX[i], y + offsetY[i]);
+				if (mOwnedComponent[neighbor] == GLOBAL_CONST_NO_COMPONENT)
+				{
+					stack.push_back(neighbor);
+				}
+			}
+		}
+		componentCount++;
+	}
+	if (depthFirst.empty())
+	{
+		PathfindingLog("A path database needs at least one walkable node");
+		return false;
+	}
+
+	// Walls never get a move, they take the order indexes after the walkable nodes
+	std::vector<int> ordered;
+	if (order == TARGET_ORDER_DFS)
+	{
+		ordered = depthFirst;
+		for (int id = 0; id < nodeCount; id++)
+		{
+			if (mOwnedComponent[id] == GLOBAL_CONST_NO_COMPONENT)
+			{
+				ordered.push_back(id);
+			}
+		}
+	}
+	else
+	{
+		uint32_t side = 1;
+		while (side < static_cast<uint32_t>(std::max(grid.columns, grid.rows)))
+		{
+			side *= 2;
+		}
+		std::vector<uint64_t> curve(nodeCount);
+		for (int id = 0; id < nodeCount; id++)
+		{
+			curve[id] = GetHilbertIndex(side, static_cast<uint32_t>(id / grid.rows), static_cast<uint32_t>(id % grid.rows));
+			ordered.push_back(id);
+		}
+		std::sort(ordered.begin(), ordered.end(), [&](int a, int b) { return curve[a] < curve[b]; });
+	}
+	mOwnedOrderIndex.assign(nodeCount, 0);
+	for (int i = 0; i < nodeCount; i++)
+	{
+		mOwnedOrderIndex[ordered[i]] = static_cast<uint32_t>(i);
+	}
+
+	// Moves each node allows, bit i for offset i, so the Dijkstras skip the wall and corner checks
+	std::vector<unsigned char> allowedMoves(nodeCount, 0);
+	int neighborDelta[8];
+	for (int i = 0; i < 8; i++)
+	{
+		neighborDelta[i] = offsetX[i] * grid.rows + offsetY[i];
+	}
+	for (int node:depthFirst)
+	{
+		const int x = node / grid.rows;
+		const int y = node % grid.rows;
+		for (int i = 0; i < config.connectivity; i++)
+		{
+			if (grid.CanStep(x, y, x + offsetX[i], y + offsetY[i], config.cutCorners))
+			{
+				allowedMoves[node] |= static_cast<unsigned char>(1 << i);
+			}
+		}
+	}
+
+	// Each worker keeps a Dijkstra and a row of moves by order index, parent holds the first move
+	std::vector<SearchSpace<int> > spaces(threadCount);
+	std::vector<std::vector<signed char> > moves(threadCount, std::vector<signed char>(nodeCount));
+	std::vector<std::vector<uint32_t> > rows(nodeCount);
+	ParallelFor(static_cast<int>(depthFirst.size()), threadCount, [&](int task, int worker) {
+		const int source = depthFirst[task];
+		SearchSpace<int>& space = spaces[worker];
+		std::vector<signed char>& row = moves[worker];
+		space.Resize(nodeCount);
+		space.Reset();
+		std::fill(row.begin(), row.end(), static_cast<signed char>(GLOBAL_CONST_NO_MOVE));
+		OpenEntryGreater<int> greater;
+		space.gCost[source] = 0;
+		space.openedIn[source] = space.generation;
+		space.openSet.push_back(OpenEntry<int>{ 0, 0, source });
+		while (!space.openSet.empty())
+		{
+			std::pop_heap(space.openSet.begin(), space.openSet.end(), greater);
+			const OpenEntry<int> entry = space.openSet.back();
+			space.openSet.pop_back();
+			const int node = entry.id;
+			if (space.closedIn[node] == space.generation)
+			{
+				continue;
+			}
+			space.closedIn[node] = space.generation;
+			if (node != source)
+			{
+				row[mOwnedOrderIndex[node]] = static_cast<signed char>(space.parent[node]);
+			}
+			for (int i = 0; i < config.connectivity; i++)
+			{
+				if (((allowedMoves[node] >> i) & 1) == 0)
+				{
+					continue;
+				}
+				const int neighbor = node + neighborDelta[i];
+				const int step = i >= 4 ? CostTraits<int>::Diagonal() : CostTraits<int>::Straight();
+				const int cost = entry.fCost + step * grid.GetTerrainCost(neighbor);
+				if (space.openedIn[neighbor] != space.generation || cost < space.gCost[neighbor])
+				{
+					space.openedIn[neighbor] = space.generation;
+					space.gCost[neighbor] = cost;
+					space.parent[neighbor] = node == source ? i : space.parent[node];
+					space.openSet.push_back(OpenEntry<int>{ cost, cost, neighbor });
+					std::push_heap(space.openSet.begin(), space.openSet.end(), greater);
+				}
+			}
+		}
+
+		// The first run starts at 0 so targets before the first real move are covered too
+		std::vector<uint32_t>& runs = rows[source];
+		int current = GLOBAL_CONST_NO_MOVE;
+		for (int i = 0; i < nodeCount; i++)
+		{
+			if (row[i] == GLOBAL_CONST_NO_MOVE || row[i] == current)
+			{
+				continue;
+			}
+			current = row[i];
+			runs.push_back((runs.empty() ? 0u : static_cast<uint32_t>(i) << 4) | static_cast<uint32_t>(current));
+		}
+		runs.shrink_to_fit();
+	});
+
+	mOwnedFirstRun.assign(nodeCount + 1, 0);
+	mOwnedRuns.clear();
+	for (int id = 0; id < nodeCount; id++)
+	{
+		mOwnedFirstRun[id] = static_cast<uint32_t>(mOwnedRuns.size());
+		mOwnedRuns.insert(mOwnedRuns.end(), rows[id].begin(), rows[id].end());
+		std::vector<uint32_t>().swap(rows[id]);
+	}
+	mOwnedFirstRun[nodeCount] = static_cast<uint32_t>(mOwnedRuns.size());
+
+	mHeader.columns = static_cast<uint32_t>(grid.columns);
+	mHeader.rows = static_cast<uint32_t>(grid.rows);
+	mHeader.connectivity = static_cast<uint32_t>(config.connectivity);
+	mHeader.cutCorners = config.cutCorners ? 1 : 0;
+	mHeader.runCount = static_cast<uint32_t>(mOwnedRuns.size());
+	mHeader.reserved = 0;
+	PointAtOwnedData();
+
+	mStats.sources = static_cast<int>(depthFirst.size());
+	mStats.runs = static_cast<int>(mOwnedRuns.size());
+	mStats.buildMs = GetElapsedMs(begin);
+	return true;
+}
+
+void PathDatabase::PointAtOwnedData()
+{
+	mOrderIndex = &mOwnedOrderIndex[0];
+	mComponent = &mOwnedComponent[0];
+	mFirstRun = &mOwnedFirstRun[0];
+	mRuns = mOwnedRuns.empty() ? nullptr : &mOwnedRuns[0];
+}
+
+size_t PathDatabase::GetMemoryBytes() const
+{
+	const size_t nodeCount = static_cast<size_t>(mHeader.columns) * mHeader.rows;
+	return IsEmpty() ? 0 : sizeof(mHeader) + (3 * nodeCount + 1 + mHeader.runCount) * sizeof(uint32_t);
+}
+
+static void AppendBytes(std::vector<unsigned char>& bytes, const void* data, size_t size)
+{
+	const unsigned char* begin = static_cast<const unsigned char*>(data);
+	bytes.insert(bytes.end(), begin, begin + size);
+}
+
+void PathDatabase::Serialize(std::vector<unsigned char>& bytes) const
+{
+	const size_t nodeCount = static_cast<size_t>(mHeader.columns) * mHeader.rows;
+	AppendBytes(bytes, &mHeader, sizeof(mHeader));
+	AppendBytes(bytes, mOrderIndex, nodeCount * sizeof(uint32_t));
+	AppendBytes(bytes, mComponent, nodeCount * sizeof(uint32_t));
+	AppendBytes(bytes, mFirstRun, (nodeCount + 1) * sizeof(uint32_t));
+	AppendBytes(bytes, mRuns, mHeader.runCount * sizeof(uint32_t));
+}
+
+// Order indexes and components in range, run offsets that never decrease and rows whose runs start at
+// order 0, rise strictly and hold moves that stay on the grid, which is what keeps the walks in bounds
+static bool AreRunsValid(const PathDatabaseSectionHeader& header, const uint32_t* orderIndex, const uint32_t* component,
+	const uint32_t* firstRun, const uint32_t* runs)
+{
+	const uint64_t nodeCount = static_cast<uint64_t>(header.columns) * header.rows;
+	if (firstRun[nodeCount] != header.runCount)
+	{
+		return false;
+	}
+	for (uint64_t node = 0; node < nodeCount; node++)
+	{
+		if (orderIndex[node] >= nodeCount || (component[node] >= nodeCount && component[node] != GLOBAL_CONST_NO_COMPONENT) ||
+			firstRun[node] > firstRun[node + 1])
+		{
+			return false;
+		}
+		const int64_t x = static_cast<int64_t>(node / header.rows);
+		const int64_t y = static_cast<int64_t>(node % header.rows);
+		for (uint32_t i = firstRun[node]; i < firstRun[node + 1]; i++)
+		{
+			const uint32_t move = runs[i] & 0xf;
+			if ((i == firstRun[node] ? (runs[i] >> 4) != 0 : runs[i] >> 4 <= runs[i - 1] >> 4) || move >= header.connectivity ||
+				x + offsetX[move] < 0 || x + offsetX[move] >= header.columns || y + offsetY[move] < 0 || y + offsetY[move] >= header.rows)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool PathDatabase::Attach(const unsigned char* data, uint64_t size)
+{
+	if (data == nullptr || size < sizeof(PathDatabaseSectionHeader))
+	{
+		PathfindingLog("Path database section is missing or truncated");
+		return false;
+	}
+	PathDatabaseSectionHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	const uint64_t nodeCount = static_cast<uint64_t>(header.columns) * header.rows;
+	const uint64_t expected = sizeof(header) + (3 * nodeCount + 1 + header.runCount) * sizeof(uint32_t);
+	if (size != expected || (header.connectivity != FOUR_CONNECTED && header.connectivity != EIGHT_CONNECTED))
+	{
+		PathfindingLog("Path database section has %llu bytes, expected %llu", static_cast<unsigned long long>(size), static_cast<unsigned long long>(expected));
+		return false;
+	}
+
+	if (nodeCount >= static_cast<uint64_t>(GLOBAL_CONST_MAX_DATABASE_NODES))
+	{
+		PathfindingLog("Path database section has %llu nodes, at most %d are supported", static_cast<unsigned long long>(nodeCount), GLOBAL_CONST_MAX_DATABASE_NODES - 1);
+		return false;
+	}
+
+	const unsigned char* position = data + sizeof(header);
+	const uint32_t* orderIndex = reinterpret_cast<const uint32_t*>(position);
+	const uint32_t* component = orderIndex + nodeCount;
+	const uint32_t* firstRun = component + nodeCount;
+	const uint32_t* runs = firstRun + nodeCount + 1;
+	if (!AreRunsValid(header, orderIndex, component, firstRun, runs))
+	{
+		PathfindingLog("Path database section has out of range order indexes, components, moves or run offsets");
+		return false;
+	}
+	mHeader = header;
+	mOrderIndex = orderIndex;
+	mComponent = component;
+	mFirstRun = firstRun;
+	mRuns = runs;
+	mStats = PathDatabaseStats();
+	mStats.runs = static_cast<int>(header.runCount);
+	return true;
+}
+
+bool PathDatabase::Matches(const GridView& grid, const SearchConfig& config) const
+{
+	return mOrderIndex != nullptr &&
+		mHeader.columns == static_cast<uint32_t>(grid.columns) &&
+		mHeader.rows == static_cast<uint32_t>(grid.rows) &&
+		mHeader.connectivity == static_cast<uint32_t>(config.connectivity) &&
+		(mHeader.cutCorners != 0) == config.cutCorners &&
+		config.mode == PATH_GRID &&
+		config.cost == COST_INT &&
+		config.agentSize == 1;
+}
+
+// The last run starting at or before the target's order index holds its move
+int PathDatabase::GetFirstMove(int start, int target) const
+{
+	if (start == target || mComponent[start] == GLOBAL_CONST_NO_COMPONENT || mComponent[start] != mComponent[target])
+	{
+		return GLOBAL_CONST_NO_MOVE;
+	}
+	const uint32_t* first = mRuns + mFirstRun[start];
+	const uint32_t* last = mRuns + mFirstRun[start + 1];
+	// A lone walkable node has no runs
+	if (first == last)
+	{
+		return GLOBAL_CONST_NO_MOVE;
+	}
+	const uint32_t* run = std::upper_bound(first, last, (mOrderIndex[target] << 4) | 0xf) - 1;
+	return static_cast<int>(*run & 0xf);
+}
+
+bool PathDatabase::FindPath(int start, int target, std::vector<int>& path) const
+{
+	path.clear();
+	if (mComponent[start] == GLOBAL_CONST_NO_COMPONENT || mComponent[start] != mComponent[target])
+	{
+		return false;
+	}
+	const int rows = static_cast<int>(mHeader.rows);
+	const size_t nodeCount = static_cast<size_t>(mHeader.columns) * mHeader.rows;
+	path.push_back(start);
+	for (int node = start; node != target;)
+	{
+		const int move = GetFirstMove(node, target);
+		// Only a damaged section could walk in circles
+		if (move == GLOBAL_CONST_NO_MOVE || path.size() > nodeCount)
+		{
+			path.clear();
+			return false;
+		}
+		node = (node / rows + offsetX[move]) * rows + node % rows + offsetY[move];
+		path.push_back(node);
+	}
+	return true;
+}
@@ -0,0 +1,98 @@
+// Compressed path database: the first move of a shortest path between any two nodes, looked up without searching
+#ifndef PATH_DATABASE_H
+#define PATH_DATABASE_H
+
+#include "pathfinding.h"
+
+#include <vector>
+
+// GetFirstMove result when there is no move to make: start and target are the same node, one of
+// them is a wall or no path joins them. Moves are otherwise 0 to 7, indexes into the offsets
+// { 1, -1, 0, 0, 1, 1, -1, -1 } and { 0, 0, 1, -1, 1, -1, 1, -1 } the searches use
+const int GLOBAL_CONST_NO_MOVE = -1;
+// Component of a wall in the section
+const uint32_t GLOBAL_CONST_NO_COMPONENT = 0xffffffff;
+// Order indexes share a run entry with the move, which takes the low 4 bits
+const int GLOBAL_CONST_MAX_DATABASE_NODES = 1 << 28;
+
+enum TargetOrder
+{
+	// Depth first over the walkable nodes, nodes behind the same doorway end up next to each other.
+	// Usually the smaller database
+	TARGET_ORDER_DFS,
+	// Hilbert curve over the map, independent of the walls
+	TARGET_ORDER_HILBERT
+};
+
+// Start of the map file section, followed by the order index and the component of every node,
+// the run offsets of every node, nodeCount + 1 long, then the runs
+struct PathDatabaseSectionHeader
+{
+	uint32_t columns;
+	uint32_t rows;
+	uint32_t connectivity;
+	uint32_t cutCorners;
+	uint32_t runCount;
+	uint32_t reserved;
+};
+
+// Counters of the last Build
+struct PathDatabaseStats
+{
+	int sources;
+	int runs;
+	double buildMs;
+};
+
+// A Dijkstra from every walkable node gives the first move towards every other node. Each source keeps
+// that row with the targets sorted by order index, run length encoded: a run is the order index where it
+// starts, shifted left 4, with the move in the low bits. Targets where any move will do (walls, the source,
+// other components) join whichever run they fall in. A first move is a binary search in one row, a path
+// follows first moves from node to node. Costs are the int costs of PathSearch for the connectivity and
+// corner rule the database was built with, with agents of one node
+class PathDatabase
+{
+public:
+	PathDatabase();
+
+	// Runs the Dijkstras on threadCount threads, one source per task. Takes a Dijkstra per node, so it is
+	// meant for maps of a few hundred thousand nodes at most, built offline
+	bool Build(const GridView& grid, const SearchConfig& config, TargetOrder order, int threadCount);
+	// Appends the map file section
+	void Serialize(std::vector<unsigned char>& bytes) const;
+	// Uses a section in place, usually from a mapped map file, which has to outlive the database
+	bool Attach(const unsigned char* data, uint64_t size);
+
+	bool IsEmpty() const { return mOrderIndex == nullptr; }
+	// True when the database answers queries of that config on that grid exactly
+	bool Matches(const GridView& grid, const SearchConfig& config) const;
+	// Walls are left out of the database, A* still answers queries starting or ending on one
+	bool Contains(int node) const { return mComponent[node] != GLOBAL_CONST_NO_COMPONENT; }
+	int GetFirstMove(int start, int target) const;
+	// Fills path with every node from start to target by chaining first moves, false when no path joins them
+	bool FindPath(int start, int target, std::vector<int>& path) const;
+	const PathDatabaseStats& GetStats() const { return mStats; }
+	size_t GetMemoryBytes() const;
+
+private:
+	PathDatabase(const PathDatabase&) = delete;
+	PathDatabase& operator=(const PathDatabase&) = delete;
+
+	void PointAtOwnedData();
+
+	PathDatabaseSectionHeader mHeader;
+	// Point into the owned vectors after Build, into the section after Attach
+	const uint32_t* mOrderIndex;
+	// Connected component of every node, walls have GLOBAL_CONST_NO_COMPONENT
+	const uint32_t* mComponent;
+	const uint32_t* mFirstRun;
+	const uint32_t* mRuns;
+
+	std::vector<uint32_t> mOwnedOrderIndex;
+	std::vector<uint32_t> mOwnedComponent;
+	std::vector<uint32_t> mOwnedFirstRun;
+	std::vector<uint32_t> mOwnedRuns;
+	PathDatabaseStats mStats;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#include "path_database.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Usage: path_database_map in out [threads] [dfs|hilbert] adds a compressed path database for the default
+// search config to a map file. The grid and any contraction hierarchy are copied out of the input first,
+// so out may be the same file
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "Usage: %s in out [threads] [dfs|hilbert]\n", argv[0]);
+		return 1;
+	}
+	const int threads = argc >= 4 ? atoi(argv[3]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	const TargetOrder order = argc >= 5 && strcmp(argv[4], "hilbert") == 0 ? TARGET_ORDER_HILBERT : TARGET_ORDER_DFS;
+
+	std::vector<unsigned char> walkableBits;
+	std::vector<unsigned char> terrainCost;
+	std::vector<unsigned char> contraction;
+	GridView grid;
+	{
+		MapFile file;
+		if (!file.Open(argv[1]) || !file.Validate())
+		{
+			return 1;
+		}
+		grid = file.GetGrid();
+		const size_t nodeCount = static_cast<size_t>(grid.columns) * grid.rows;
+		walkableBits.assign(grid.walkableBits, grid.walkableBits + (nodeCount + 7) / 8);
+		grid.walkableBits = &walkableBits[0];
+		if (grid.terrainCost != nullptr)
+		{
+			terrainCost.assign(grid.terrainCost, grid.terrainCost + nodeCount);
+			grid.terrainCost = &terrainCost[0];
+		}
+		uint64_t size = 0;
+		const unsigned char* section = file.GetSection(MAP_SECTION_CONTRACTION, &size);
+		if (section != nullptr)
+		{
+			contraction.assign(section, section + size);
+		}
+	}
+
+	PathDatabase database;
+	if (!database.Build(grid, MakeDefaultSearchConfig(), order, threads))
+	{
+		return 1;
+	}
+	std::vector<unsigned char> section;
+	database.Serialize(section);
+	std::vector<MapSectionData> sections;
+	MapSectionData pathDatabase = { MAP_SECTION_PATH_DATABASE, &section[0], section.size() };
+	sections.push_back(pathDatabase);
+	if (!contraction.empty())
+	{
+		MapSectionData kept = { MAP_SECTION_CONTRACTION, &contraction[0], contraction.size() };
+		sections.push_back(kept);
+	}
+	if (!MapFile::Write(argv[2], grid, sections))
+	{
+		return 1;
+	}
+	const PathDatabaseStats& stats = database.GetStats();
+	printf("%d sources, %d runs, %.1f runs per source, %.0f ms on %d threads, %zu byte section\n",
+		stats.sources, stats.runs, static_cast<double>(stats.runs) / stats.sources, stats.buildMs, std::max(1, threads), section.size());
+	return 0;
+}
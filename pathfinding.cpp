@@ -0,0 +1,984 @@
+#include "pathfinding.h"
+#include "landmarks.h"
+#include "contraction.h"
+#include "path_database.h"
+#include "subgoal_graph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void PathfindingLog(const char* format, ...)
+{
+	va_list arguments;
+	va_start(arguments, format);
+	vfprintf(stderr, format, arguments);
+	va_end(arguments);
+	fputc('\n', stderr);
+}
+
+// Settings the editor starts with and the server always uses
+SearchConfig MakeDefaultSearchConfig()
+{
+	SearchConfig config;
+	config.connectivity = EIGHT_CONNECTED;
+	config.cutCorners = true;
+	config.mode = PATH_GRID;
+	config.smoothPath = true;
+	config.heuristic = HEURISTIC_OCTILE;
+	config.cost = COST_INT;
+	config.recordTrace = false;
+	config.agentSize = 1;
+	return config;
+}
+
+// Milliseconds since begin on the high resolution clock
+double GetElapsedMs(std::chrono::steady_clock::time_point begin)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+SearchTrace::SearchTrace()
+{
+	mEvents.resize(GLOBAL_CONST_TRACE_CAPACITY);
+	mCount = 0;
+}
+
+void SearchTrace::CopyTo(std::vector<unsigned int>& events) const
+{
+	events.clear();
+	size_t first = mCount > GLOBAL_CONST_TRACE_CAPACITY ? mCount - GLOBAL_CONST_TRACE_CAPACITY : 0;
+	for (size_t i = first; i < mCount; i++)
+	{
+		events.push_back(mEvents[i & (GLOBAL_CONST_TRACE_CAPACITY - 1)]);
+	}
+}
+
+// Packs a byte per node walkability into the GridView bit layout
+void PackWalkableBits(const std::vector<unsigned char>& walkable, std::vector<unsigned char>& bits)
+{
+	bits.assign((walkable.size() + 7) / 8, 0);
+	for (size_t id = 0; id < walkable.size(); id++)
+	{
+		if (walkable[id])
+		{
+			bits[id >> 3] |= static_cast<unsigned char>(1 << (id & 7));
+		}
+	}
+}
+
+// A walkable node clears one more than the least of its right, lower and lower right neighbors, nodes past the edge clear nothing
+static unsigned char GetNodeClearance(const GridView& grid, int x, int y, const std::vector<unsigned char>& clearance)
+{
+	if (!grid.IsWalkable(x, y))
+	{
+		return 0;
+	}
+	const int id = grid.GetCellId(x, y);
+	const bool right = x + 1 < grid.columns;
+	const bool below = y + 1 < grid.rows;
+	int least = right && below ? std::min(std::min(clearance[id + grid.rows], clearance[id + 1]), clearance[id + grid.rows + 1]) : 0;
+	return static_cast<unsigned char>(std::min(least + 1, GLOBAL_CONST_MAX_AGENT_SIZE));
+}
+
+// Right to left and bottom to top, so the neighbors a node reads are always done
+void ComputeClearance(const GridView& grid, std::vector<unsigned char>& clearance)
+{
+	clearance.assign(grid.columns * grid.rows, 0);
+	for (int x = grid.columns - 1; x >= 0; x--)
+	{
+		for (int y = grid.rows - 1; y >= 0; y--)
+		{
+			clearance[grid.GetCellId(x, y)] = GetNodeClearance(grid, x, y, clearance);
+		}
+	}
+}
+
+void UpdateClearance(const GridView& grid, int x, int y, std::vector<unsigned char>& clearance)
+{
+	for (int column = x; column >= 0 && column > x - GLOBAL_CONST_MAX_AGENT_SIZE; column--)
+	{
+		for (int row = y; row >= 0 && row > y - GLOBAL_CONST_MAX_AGENT_SIZE; row--)
+		{
+			clearance[grid.GetCellId(column, row)] = GetNodeClearance(grid, column, row, clearance);
+		}
+	}
+}
+
+MapFile::MapFile()
+{
+	mData = nullptr;
+	mSize = 0;
+	mHeader = nullptr;
+	mSections = nullptr;
+}
+
+MapFile::~MapFile()
+{
+	Close();
+}
+
+void MapFile::Close()
+{
+	if (mData != nullptr)
+	{
+		munmap(mData, mSize);
+	}
+	mData = nullptr;
+	mSize = 0;
+	mHeader = nullptr;
+	mSections = nullptr;
+}
+
+bool MapFile::Open(const char* path)
+{
+	Close();
+	int descriptor = open(path, O_RDONLY);
+	if (descriptor < 0)
+	{
+		PathfindingLog("Failed to open map %s: %s", path, strerror(errno));
+		return false;
+	}
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(MapFileHeader)))
+	{
+		PathfindingLog("Map %s is too small", path);
+		close(descriptor);
+		return false;
+	}
+	mSize = static_cast<size_t>(status.st_size);
+	void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	// The mapping keeps the file alive on its own
+	close(descriptor);
+	if (data == MAP_FAILED)
+	{
+		PathfindingLog("Failed to map %s: %s", path, strerror(errno));
+		mSize = 0;
+		return false;
+	}
+	mData = data;
+
+	const MapFileHeader* header = static_cast<const MapFileHeader*>(mData);
+	const uint64_t nodeCount = static_cast<uint64_t>(header->columns) * header->rows;
+	const uint64_t tableEnd = sizeof(MapFileHeader) + static_cast<uint64_t>(header->sectionCount) * sizeof(MapFileSection);
+	if (std::memcmp(header->magic, GLOBAL_CONST_MAP_MAGIC, 4) != 0 || header->version != GLOBAL_CONST_MAP_VERSION)
+	{
+		PathfindingLog("Map %s is not a version %u map file", path, GLOBAL_CONST_MAP_VERSION);
+		Close();
+		return false;
+	}
+	// Node ids are ints
+	if (nodeCount == 0 || nodeCount > static_cast<uint64_t>(std::numeric_limits<int>::max()) || tableEnd > mSize ||
+		header->minTerrainCost < 1 || header->minTerrainCost > 255)
+	{
+		PathfindingLog("Map %s has a corrupt header", path);
+		Close();
+		return false;
+	}
+
+	const MapFileSection* sections = reinterpret_cast<const MapFileSection*>(header + 1);
+	for (uint32_t i = 0; i < header->sectionCount; i++)
+	{
+		const MapFileSection& section = sections[i];
+		if (section.offset % 8 != 0 || section.offset > mSize || section.size > mSize - section.offset)
+		{
+			PathfindingLog("Map %s has a section outside the file", path);
+			Close();
+			return false;
+		}
+	}
+	mHeader = header;
+	mSections = sections;
+
+	uint64_t walkableSize = 0;
+	uint64_t terrainSize = 0;
+	if (GetSection(MAP_SECTION_WALKABLE, &walkableSize) == nullptr || walkableSize < (nodeCount + 7) / 8 ||
+		(GetSection(MAP_SECTION_TERRAIN, &terrainSize) != nullptr && terrainSize < nodeCount))
+	{
+		PathfindingLog("Map %s is missing grid data", path);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+// A walkable node cheaper than minTerrainCost makes the scaled heuristic overestimate, a free
+// one makes every path through it look optimal. Walls may hold anything
+static bool IsTerrainValid(const GridView& grid)
+{
+	if (grid.terrainCost == nullptr)
+	{
+		return grid.minTerrainCost <= TERRAIN_GROUND;
+	}
+	const int nodeCount = grid.columns * grid.rows;
+	for (int id = 0; id < nodeCount; id++)
+	{
+		if (grid.terrainCost[id] < grid.minTerrainCost && ((grid.walkableBits[id >> 3] >> (id & 7)) & 1))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool MapFile::Validate() const
+{
+	if (!IsOpen() || !IsTerrainValid(GetGrid()))
+	{
+		PathfindingLog("Map has terrain costs below its minimum terrain cost");
+		return false;
+	}
+	return true;
+}
+
+GridView MapFile::GetGrid() const
+{
+	GridView grid;
+	grid.columns = static_cast<int>(mHeader->columns);
+	grid.rows = static_cast<int>(mHeader->rows);
+	grid.walkableBits = GetSection(MAP_SECTION_WALKABLE, nullptr);
+	grid.terrainCost = GetSection(MAP_SECTION_TERRAIN, nullptr);
+	grid.minTerrainCost = static_cast<int>(mHeader->minTerrainCost);
+	grid.clearance = nullptr;
+	grid.landmarks = nullptr;
+	grid.contraction = nullptr;
+	grid.pathDatabase = nullptr;
+	grid.subgoals = nullptr;
+	return grid;
+}
+
+const unsigned char* MapFile::GetSection(uint32_t type, uint64_t* size) const
+{
+	for (uint32_t i = 0; mHeader != nullptr && i < mHeader->sectionCount; i++)
+	{
+		if (mSections[i].type == type)
+		{
+			if (size != nullptr)
+			{
+				*size = mSections[i].size;
+			}
+			return static_cast<const unsigned char*>(mData) + mSections[i].offset;
+		}
+	}
+	return nullptr;
+}
+
+bool MapFile::Write(const char* path, const GridView& grid, const std::vector<MapSectionData>& extraSections)
+{
+	if (!IsTerrainValid(grid))
+	{
+		PathfindingLog("Not writing %s, it has terrain costs below its minimum terrain cost", path);
+		return false;
+	}
+	const uint64_t nodeCount = static_cast<uint64_t>(grid.columns) * grid.rows;
+	std::vector<MapSectionData> data;
+	MapSectionData walkable = { MAP_SECTION_WALKABLE, grid.walkableBits, (nodeCount + 7) / 8 };
+	data.push_back(walkable);
+	if (grid.terrainCost != nullptr)
+	{
+		MapSectionData terrain = { MAP_SECTION_TERRAIN, grid.terrainCost, nodeCount };
+		data.push_back(terrain);
+	}
+	data.insert(data.end(), extraSections.begin(), extraSections.end());
+
+	MapFileHeader header;
+	std::memcpy(header.magic, GLOBAL_CONST_MAP_MAGIC, 4);
+	header.version = GLOBAL_CONST_MAP_VERSION;
+	header.columns = static_cast<uint32_t>(grid.columns);
+	header.rows = static_cast<uint32_t>(grid.rows);
+	header.minTerrainCost = static_cast<uint32_t>(grid.minTerrainCost);
+	header.sectionCount = static_cast<uint32_t>(data.size());
+
+	std::vector<MapFileSection> sections(data.size());
+	uint64_t offset = sizeof(MapFileHeader) + data.size() * sizeof(MapFileSection);
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		offset = (offset + 7) & ~static_cast<uint64_t>(7);
+		sections[i].type = data[i].type;
+		sections[i].reserved = 0;
+		sections[i].offset = offset;
+		sections[i].size = data[i].size;
+		offset += data[i].size;
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr)
+	{
+		PathfindingLog("Failed to open %s for writing", path);
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(&sections[0], sizeof(MapFileSection), sections.size(), file) == sections.size();
+	uint64_t position = sizeof(MapFileHeader) + data.size() * sizeof(MapFileSection);
+	static const char padding[8] = { 0 };
+	for (size_t i = 0; written && i < data.size(); i++)
+	{
+		written = fwrite(padding, 1, sections[i].offset - position, file) == sections[i].offset - position &&
+			fwrite(data[i].data, 1, data[i].size, file) == data[i].size;
+		position = sections[i].offset + data[i].size;
+	}
+	if (fclose(file) != 0 || !written)
+	{
+		PathfindingLog("Failed to write map %s", path);
+		return false;
+	}
+	return true;
+}
+
+PathSearch::PathSearch()
+{
+	mColumns = 0;
+	mRows = 0;
+	mWalkableBits = nullptr;
+	mTerrainCost = nullptr;
+	mMinTerrainCost = 1;
+	mClearance = nullptr;
+	mLandmarks = nullptr;
+	mConfig = MakeDefaultSearchConfig();
+	mStats = SearchStats();
+}
+
+// A node is walkable for a larger agent when its whole square fits, a single compare against the clearance
+bool PathSearch::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= mColumns || y < 0 || y >= mRows)
+	{
+		return false;
+	}
+	const int id = GetCellId(x, y);
+	if (mConfig.agentSize > 1)
+	{
+		return mClearance[id] >= mConfig.agentSize;
+	}
+	return (mWalkableBits[id >> 3] >> (id & 7)) & 1;
+}
+
+// Checks a single step between adjacent nodes, diagonals may not squeeze past a wall unless corner cutting is on
+template <bool CutCorners>
+bool PathSearch::CanStep(int x, int y, int neighborX, int neighborY) const
+{
+	if (!IsWalkable(neighborX, neighborY))
+	{
+		return false;
+	}
+	if (!CutCorners && x != neighborX && y != neighborY)
+	{
+		return IsWalkable(neighborX, y) && IsWalkable(x, neighborY);
+	}
+	return true;
+}
+
+// Walks every node the line between two node centers passes through,
+// returns the highest terrain cost entered or 0 when a wall blocks the line
+template <bool CutCorners>
+int PathSearch::LineOfSight(int from, int to) const
+{
+	int x = from / mRows;
+	int y = from % mRows;
+	const int toX = to / mRows;
+	const int toY = to % mRows;
+	const int stepX = toX > x ? 1 : -1;
+	const int stepY = toY > y ? 1 : -1;
+	int dx = std::abs(toX - x);
+	int dy = std::abs(toY - y);
+	int error = dx - dy;
+	dx *= 2;
+	dy *= 2;
+
+	int maxTerrainCost = GetTerrainCost(to);
+	while (x != toX || y != toY)
+	{
+		if (error > 0)
+		{
+			x += stepX;
+			error -= dy;
+		}
+		else if (error < 0)
+		{
+			y += stepY;
+			error += dx;
+		}
+		else
+		{
+			// The line crosses exactly through a corner, same rule as a diagonal step
+			if (!CutCorners && (!IsWalkable(x + stepX, y) || !IsWalkable(x, y + stepY)))
+			{
+				return 0;
+			}
+			x += stepX;
+			y += stepY;
+			error += dx - dy;
+		}
+
+		if (!IsWalkable(x, y))
+		{
+			return 0;
+		}
+		maxTerrainCost = std::max(maxTerrainCost, GetTerrainCost(GetCellId(x, y)));
+	}
+	return maxTerrainCost;
+}
+
+// Straight line cost between two nodes, the length times the straight step cost, so a one node
+// segment costs what the grid step does. Int costs round instead of truncating like the heuristic
+template <typename CostT>
+CostT PathSearch::GetSegmentCost(int from, int to, int terrainCost) const
+{
+	int dx = std::abs(from / mRows - to / mRows);
+	int dy = std::abs(from % mRows - to % mRows);
+	double length = std::sqrt(static_cast<double>(dx * dx + dy * dy));
+	double rounding = std::numeric_limits<CostT>::is_integer ? 0.5 : 0.0;
+	return static_cast<CostT>(length * CostTraits<CostT>::Straight() + rounding) * static_cast<CostT>(terrainCost);
+}
+
+template <>
+SearchSpace<int>& PathSearch::GetSearchSpace<int>()
+{
+	return mIntSearch;
+}
+
+template <>
+SearchSpace<float>& PathSearch::GetSearchSpace<float>()
+{
+	return mFloatSearch;
+}
+
+// Runtime dispatch over the search settings, resolved once per query so the kernel itself has no branches on them
+bool PathSearch::FindPath(const GridView& grid, int start, int target, const SearchConfig& config)
+{
+	mColumns = grid.columns;
+	mRows = grid.rows;
+	mWalkableBits = grid.walkableBits;
+	mTerrainCost = grid.terrainCost;
+	mMinTerrainCost = grid.minTerrainCost;
+	mClearance = grid.clearance;
+	mLandmarks = grid.landmarks;
+	mConfig = config;
+	mIntSearch.Resize(grid.columns * grid.rows);
+	mFloatSearch.Resize(grid.columns * grid.rows);
+	mStats = SearchStats();
+	mTrace.Clear();
+
+	const int nodeCount = grid.columns * grid.rows;
+	if (start < 0 || target < 0 || start >= nodeCount || target >= nodeCount)
+	{
+		mPath.clear();
+		return false;
+	}
+	if (mConfig.agentSize > 1 && (mClearance == nullptr || mConfig.agentSize > GLOBAL_CONST_MAX_AGENT_SIZE))
+	{
+		PathfindingLog("Agent size %d needs a clearance map and at most %d nodes", mConfig.agentSize, GLOBAL_CONST_MAX_AGENT_SIZE);
+		mPath.clear();
+		return false;
+	}
+	if (mConfig.heuristic == HEURISTIC_LANDMARKS && (mLandmarks == nullptr || mLandmarks->GetNodeCount() != mColumns * mRows))
+	{
+		PathfindingLog("The landmark heuristic needs a landmark table built for this grid");
+		mPath.clear();
+		return false;
+	}
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	bool found;
+	// The kernels smooth their own paths, the precomputed ones are smoothed below
+	bool precomputed = true;
+	if (grid.pathDatabase != nullptr && grid.pathDatabase->Matches(grid, mConfig) &&
+		grid.pathDatabase->Contains(start) && grid.pathDatabase->Contains(target))
+	{
+		// Lookups replace the search, nothing counts as expanded
+		found = grid.pathDatabase->FindPath(start, target, mPath);
+	}
+	else if (grid.contraction != nullptr && grid.contraction->Matches(grid, mConfig) &&
+		grid.contraction->Contains(start) && grid.contraction->Contains(target))
+	{
+		// Nodes settled by the two upward searches count as expanded, the trace stays empty
+		found = grid.contraction->FindPath(start, target, mIntSearch, mBackwardSearch, mPath, mStats.nodesExpanded);
+	}
+	else if (grid.subgoals != nullptr && grid.subgoals->Matches(grid, mConfig) &&
+		grid.subgoals->Contains(start) && grid.subgoals->Contains(target))
+	{
+		// Subgoals the search expanded count as expanded
+		found = grid.subgoals->FindPath(start, target, mIntSearch, mBackwardSearch, mPath, mStats.nodesExpanded);
+	}
+	else if (mConfig.cost == COST_FLOAT)
+	{
+		precomputed = false;
+		found = DispatchConnectivity<float>(start, target);
+	}
+	else
+	{
+		precomputed = false;
+		found = DispatchConnectivity<int>(start, target);
+	}
+	if (found && precomputed && mConfig.smoothPath && mConfig.cutCorners)
+	{
+		SmoothPath<true>(mPath);
+	}
+	else if (found && precomputed && mConfig.smoothPath)
+	{
+		SmoothPath<false>(mPath);
+	}
+	mStats.findPathMs = GetElapsedMs(begin);
+	mStats.pathLength = found ? GetPathLength() : 0.0f;
+	return found;
+}
+
+// Euclidean length of the waypoint polyline in nodes
+float PathSearch::GetPathLength() const
+{
+	float length = 0.0f;
+	for (size_t i = 1; i < mPath.size(); i++)
+	{
+		float dx = static_cast<float>(mPath[i] / mRows - mPath[i - 1] / mRows);
+		float dy = static_cast<float>(mPath[i] % mRows - mPath[i - 1] % mRows);
+		length += std::sqrt(dx * dx + dy * dy);
+	}
+	return length;
+}
+
+template <typename CostT>
+bool PathSearch::DispatchConnectivity(int start, int target)
+{
+	if (mConfig.connectivity == FOUR_CONNECTED)
+	{
+		return DispatchCorners<CostT, FOUR_CONNECTED>(start, target);
+	}
+	return DispatchCorners<CostT, EIGHT_CONNECTED>(start, target);
+}
+
+template <typename CostT, int Connectivity>
+bool PathSearch::DispatchCorners(int start, int target)
+{
+	if (mConfig.cutCorners)
+	{
+		return DispatchMode<CostT, Connectivity, true>(start, target);
+	}
+	return DispatchMode<CostT, Connectivity, false>(start, target);
+}
+
+template <typename CostT, int Connectivity, bool CutCorners>
+bool PathSearch::DispatchMode(int start, int target)
+{
+	switch (mConfig.mode)
+	{
+		case PATH_THETA:
+		return DispatchHeuristic<CostT, Connectivity, CutCorners, PATH_THETA>(start, target);
+
+		case PATH_LAZY_THETA:
+		return DispatchHeuristic<CostT, Connectivity, CutCorners, PATH_LAZY_THETA>(start, target);
+
+		default:
+		return DispatchHeuristic<CostT, Connectivity, CutCorners, PATH_GRID>(start, target);
+	}
+}
+
+template <typename CostT, int Connectivity, bool CutCorners, int Mode>
+bool PathSearch::DispatchHeuristic(int start, int target)
+{
+	switch (mConfig.heuristic)
+	{
+		case HEURISTIC_MANHATTAN:
+		return FindPathKernel<Connectivity, CutCorners, Mode, ManhattanHeuristic, CostT>(start, target);
+
+		case HEURISTIC_EUCLIDEAN:
+		return FindPathKernel<Connectivity, CutCorners, Mode, EuclideanHeuristic, CostT>(start, target);
+
+		case HEURISTIC_ZERO:
+		return FindPathKernel<Connectivity, CutCorners, Mode, ZeroHeuristic, CostT>(start, target);
+
+		case HEURISTIC_LANDMARKS:
+		return FindPathKernel<Connectivity, CutCorners, Mode, LandmarkHeuristic, CostT>(start, target);
+
+		default:
+		return FindPathKernel<Connectivity, CutCorners, Mode, OctileHeuristic, CostT>(start, target);
+	}
+}
+
+// No step can be cheaper than the cheapest terrain, scaling by it keeps the heuristic admissible
+template <typename HeuristicT, typename CostT>
+CostT PathSearch::Estimate(int, int, int dx, int dy) const
+{
+	return static_cast<CostT>(mMinTerrainCost) * HeuristicT::template Estimate<CostT>(dx, dy);
+}
+
+// Landmark distances already include the terrain, int units are the search's own. Open areas far
+// from every landmark bound poorly, the octile estimate takes over there since the max of both stays admissible
+template <>
+int PathSearch::Estimate<LandmarkHeuristic, int>(int node, int target, int dx, int dy) const
+{
+	return std::max(mLandmarks->Estimate(node, target), Estimate<OctileHeuristic, int>(node, target, dx, dy));
+}
+
+// Float steps are a tenth of the int ones, and 1.4 stays below the float diagonal
+template <>
+float PathSearch::Estimate<LandmarkHeuristic, float>(int node, int target, int dx, int dy) const
+{
+	return std::max(static_cast<float>(mLandmarks->Estimate(node, target)) * 0.1f, Estimate<OctileHeuristic, float>(node, target, dx, dy));
+}
+
+// Lazy Theta* generates nodes assuming their parent can see them, this checks that once the node is expanded.
+// Without line of sight the node falls back to its cheapest expanded neighbor, which always exists
+template <int Connectivity, bool CutCorners, typename CostT>
+void PathSearch::SetVertex(SearchSpace<CostT>& space, int node)
+{
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	const int parent = space.parent[node];
+	const int lineTerrainCost = LineOfSight<CutCorners>(parent, node);
+	CostT bestCost = CostTraits<CostT>::Infinity();
+	int bestParent = parent;
+	if (lineTerrainCost > 0)
+	{
+		bestCost = space.gCost[parent] + GetSegmentCost<CostT>(parent, node, lineTerrainCost);
+	}
+
+	const int x = node / mRows;
+	const int y = node % mRows;
+	for (int i = 0; i < Connectivity; i++)
+	{
+		const int neighborX = x + offsetX[i];
+		const int neighborY = y + offsetY[i];
+		if (!CanStep<CutCorners>(x, y, neighborX, neighborY))
+		{
+			continue;
+		}
+
+		const int neighbor = GetCellId(neighborX, neighborY);
+		if (space.closedIn[neighbor] != space.generation)
+		{
+			continue;
+		}
+
+		CostT step = i >= 4 ? CostTraits<CostT>::Diagonal() : CostTraits<CostT>::Straight();
+		CostT cost = space.gCost[neighbor] + step * static_cast<CostT>(GetTerrainCost(node));
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestParent = neighbor;
+		}
+	}
+
+	space.gCost[node] = bestCost;
+	space.parent[node] = bestParent;
+}
+
+// A* over the node grid, one instantiation per movement rule, path mode, heuristic and cost type.
+// The any-angle modes are not optimal and the octile heuristic can overestimate their shortcuts, pair them with Euclidean
+template <int Connectivity, bool CutCorners, int Mode, typename HeuristicT, typename CostT>
+bool PathSearch::FindPathKernel(int start, int target)
+{
+	// Orthogonal steps first so four-connected kernels only walk the front of the table
+	static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+	static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+
+	SearchSpace<CostT>& space = GetSearchSpace<CostT>();
+	space.Reset();
+	OpenEntryGreater<CostT> greater;
+
+	const int targetX = target / mRows;
+	const int targetY = target % mRows;
+
+	space.gCost[start] = CostT();
+	space.parent[start] = start;
+	space.openedIn[start] = space.generation;
+	CostT startH = Estimate<HeuristicT, CostT>(start, target, std::abs(start / mRows - targetX), std::abs(start % mRows - targetY));
+	OpenEntry<CostT> startEntry = { startH, startH, start };
+	space.openSet.push_back(startEntry);
+#if PATHFINDING_SEARCH_TRACE
+	const bool recordTrace = mConfig.recordTrace;
+	if (recordTrace)
+	{
+		mTrace.Record(start, false);
+	}
+#endif
+
+	while (space.openSet.size() > 0)
+	{
+		std::pop_heap(space.openSet.begin(), space.openSet.end(), greater);
+		int current = space.openSet.back().id;
+		space.openSet.pop_back();
+
+		// Stale entry left behind by a cheaper push of the same node
+		if (space.closedIn[current] == space.generation)
+		{
+			continue;
+		}
+		space.closedIn[current] = space.generation;
+		mStats.nodesExpanded++;
+#if PATHFINDING_SEARCH_TRACE
+		if (recordTrace)
+		{
+			mTrace.Record(current, true);
+		}
+#endif
+
+		if (Mode == PATH_LAZY_THETA && current != start)
+		{
+			SetVertex<Connectivity, CutCorners>(space, current);
+		}
+
+		if (current == target)
+		{
+			std::chrono::steady_clock::time_point retraceBegin = std::chrono::steady_clock::now();
+			RetracePath(space.parent, start, target);
+			mStats.retraceMs = GetElapsedMs(retraceBegin);
+			if (mConfig.smoothPath)
+			{
+				SmoothPath<CutCorners>(mPath);
+			}
+			return true;
+		}
+
+		const int x = current / mRows;
+		const int y = current % mRows;
+		const CostT currentG = space.gCost[current];
+		const int currentParent = space.parent[current];
+
+		for (int i = 0; i < Connectivity; i++)
+		{
+			const int neighborX = x + offsetX[i];
+			const int neighborY = y + offsetY[i];
+			if (!CanStep<CutCorners>(x, y, neighborX, neighborY))
+			{
+				continue;
+			}
+
+			const bool diagonal = i >= 4;
+			const int neighbor = GetCellId(neighborX, neighborY);
+			if (space.closedIn[neighbor] == space.generation)
+			{
+				continue;
+			}
+
+			// The base step is scaled by the cost of the node being entered
+			CostT step = diagonal ? CostTraits<CostT>::Diagonal() : CostTraits<CostT>::Straight();
+			CostT newMovementCostToNeighbor = currentG + step * static_cast<CostT>(GetTerrainCost(neighbor));
+			int newParent = current;
+
+			if (Mode == PATH_THETA)
+			{
+				// Link straight to the parent of current when it can see the neighbor and that is no more expensive
+				const int lineTerrainCost = LineOfSight<CutCorners>(currentParent, neighbor);
+				if (lineTerrainCost > 0)
+				{
+					CostT lineCost = space.gCost[currentParent] + GetSegmentCost<CostT>(currentParent, neighbor, lineTerrainCost);
+					if (lineCost <= newMovementCostToNeighbor)
+					{
+						newMovementCostToNeighbor = lineCost;
+						newParent = currentParent;
+					}
+				}
+			}
+			else if (Mode == PATH_LAZY_THETA)
+			{
+				// Assume line of sight for now, SetVertex checks it if the neighbor is ever expanded
+				newMovementCostToNeighbor = space.gCost[currentParent] + GetSegmentCost<CostT>(currentParent, neighbor, GetTerrainCost(neighbor));
+				newParent = currentParent;
+			}
+
+			if (space.openedIn[neighbor] != space.generation || newMovementCostToNeighbor < space.gCost[neighbor])
+			{
+				space.openedIn[neighbor] = space.generation;
+				space.gCost[neighbor] = newMovementCostToNeighbor;
+				space.parent[neighbor] = newParent;
+
+				CostT h = Estimate<HeuristicT, CostT>(neighbor, target, std::abs(neighborX - targetX), std::abs(neighborY - targetY));
+				OpenEntry<CostT> entry = { newMovementCostToNeighbor + h, h, neighbor };
+				space.openSet.push_back(entry);
+				std::push_heap(space.openSet.begin(), space.openSet.end(), greater);
+				mStats.openPeak = std::max(mStats.openPeak, static_cast<int>(space.openSet.size()));
+#if PATHFINDING_SEARCH_TRACE
+				if (recordTrace)
+				{
+					mTrace.Record(neighbor, false);
+				}
+#endif
+			}
+		}
+	}
+
+	mPath.clear();
+	return false;
+}
+
+// Used to draw the shortest path after find path completes (if a path is available)
+void PathSearch::RetracePath(const std::vector<int>& parent, int start, int target)
+{
+	mPath.clear();
+	int current = target;
+
+	while (current != start)
+	{
+		mPath.push_back(current);
+		current = parent[current];
+	}
+	mPath.push_back(start);
+
+	std::reverse(mPath.begin(), mPath.end());
+}
+
+// True when b lies on the straight run from a to c, heading the same way
+bool PathSearch::IsCollinear(int a, int b, int c) const
+{
+	const int abX = b / mRows - a / mRows;
+	const int abY = b % mRows - a % mRows;
+	const int bcX = c / mRows - b / mRows;
+	const int bcY = c % mRows - b % mRows;
+	return abX * bcY - abY * bcX == 0 && abX * bcX + abY * bcY > 0;
+}
+
+// Reduces a path to a compact waypoint list in place. Collinear runs are collapsed first,
+// then string pulling drops every waypoint the previous kept one can see past.
+// A shortcut is only taken when it costs no more than the route it replaces
+template <bool CutCorners>
+void PathSearch::SmoothPath(std::vector<int>& path) const
+{
+	if (path.size() < 3)
+	{
+		return;
+	}
+
+	int count = 1;
+	for (int i = 1; i + 1 < static_cast<int>(path.size()); i++)
+	{
+		if (!IsCollinear(path[count - 1], path[i], path[i + 1]))
+		{
+			path[count++] = path[i];
+		}
+	}
+	path[count++] = path.back();
+
+	// Kept waypoints are written behind the read position, so this also runs in place
+	int kept = 1;
+	int anchor = 0;
+	float routeCost = GetRouteCost<CutCorners>(path[0], path[1]);
+	for (int i = 2; i < count; i++)
+	{
+		routeCost += GetRouteCost<CutCorners>(path[i - 1], path[i]);
+		int lineTerrainCost = LineOfSight<CutCorners>(path[anchor], path[i]);
+		// Without terrain every visible line is shorter than the route around it
+		bool keepAnchor = lineTerrainCost == 0 ||
+			(mTerrainCost != nullptr && GetSegmentCost<float>(path[anchor], path[i], lineTerrainCost) > routeCost);
+		if (keepAnchor)
+		{
+			anchor = i - 1;
+			path[kept++] = path[anchor];
+			routeCost = GetRouteCost<CutCorners>(path[anchor], path[i]);
+		}
+	}
+	path[kept++] = path[count - 1];
+	path.resize(kept);
+}
+
+// Straight and diagonal runs are charged step by step like the grid kernels, other
+// segments come from the any-angle modes and are charged like they charge them
+template <bool CutCorners>
+float PathSearch::GetRouteCost(int from, int to) const
+{
+	const int dx = to / mRows - from / mRows;
+	const int dy = to % mRows - from % mRows;
+	if (dx != 0 && dy != 0 && std::abs(dx) != std::abs(dy))
+	{
+		return GetSegmentCost<float>(from, to, LineOfSight<CutCorners>(from, to));
+	}
+
+	const int stepX = dx > 0 ? 1 : dx < 0 ? -1 : 0;
+	const int stepY = dy > 0 ? 1 : dy < 0 ? -1 : 0;
+	const float step = stepX != 0 && stepY != 0 ? CostTraits<float>::Diagonal() : CostTraits<float>::Straight();
+	float cost = 0.0f;
+	for (int id = from; id != to;)
+	{
+		id += stepX * mRows + stepY;
+		cost += step * static_cast<float>(GetTerrainCost(id));
+	}
+	return cost;
+}
+
+BatchSolver::BatchSolver(int threadCount)
+{
+	mGrid = nullptr;
+	mConfig = nullptr;
+	mQueries = nullptr;
+	mNext = 0;
+	mRemaining = 0;
+	mStopping = false;
+	for (int i = 0; i < std::max(1, threadCount); i++)
+	{
+		mWorkers.push_back(std::thread(&BatchSolver::WorkerLoop, this));
+	}
+}
+
+BatchSolver::~BatchSolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWake.notify_all();
+	for (std::thread& worker:mWorkers)
+	{
+		worker.join();
+	}
+}
+
+void BatchSolver::Solve(const GridView& grid, const SearchConfig& config, std::vector<PathQuery>& queries)
+{
+	if (queries.empty())
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mGrid = &grid;
+	mConfig = &config;
+	mQueries = &queries;
+	mNext = 0;
+	mRemaining = queries.size();
+	mWake.notify_all();
+	mDone.wait(lock, [this]() { return mRemaining == 0; });
+	mQueries = nullptr;
+}
+
+// Workers pull one query at a time, so long searches do not hold up a whole share of the batch
+void BatchSolver::WorkerLoop()
+{
+	PathSearch search;
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		mWake.wait(lock, [this]() { return mStopping || (mQueries != nullptr && mNext < mQueries->size()); });
+		if (mStopping)
+		{
+			return;
+		}
+
+		PathQuery& query = (*mQueries)[mNext++];
+		const GridView grid = *mGrid;
+		const SearchConfig config = *mConfig;
+		lock.unlock();
+
+		query.found = search.FindPath(grid, query.start, query.target, config);
+		query.length = search.GetStats().pathLength;
+		query.path.assign(search.GetPath().begin(), search.GetPath().end());
+		if (!query.found)
+		{
+			query.path.clear();
+		}
+
+		lock.lock();
+		if (--mRemaining == 0)
+		{
+			mDone.notify_one();
+		}
+	}
+}
@@ -0,0 +1,541 @@
+// Grid path search without any windowing dependency, the visualizer and the
+// query server are both built on it. Node ids run column by column, id = x * rows + y
+#ifndef PATHFINDING_H
+#define PATHFINDING_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+// Build with -DPATHFINDING_SEARCH_TRACE=0 to compile the search trace out of the kernel
+#ifndef PATHFINDING_SEARCH_TRACE
+#define PATHFINDING_SEARCH_TRACE 1
+#endif
+
+// Search events the trace keeps, a power of two so the ring index is a mask
+const size_t GLOBAL_CONST_TRACE_CAPACITY = 1 << 16;
+// Largest agent side in nodes, clearance values are capped here
+const int GLOBAL_CONST_MAX_AGENT_SIZE = 16;
+
+// Reports errors on stderr, printf style, the newline is added
+void PathfindingLog(const char* format, ...);
+
+// Movement rules the A* kernel can be specialized on
+enum Connectivity
+{
+	FOUR_CONNECTED = 4,
+	EIGHT_CONNECTED = 8
+};
+
+enum HeuristicType
+{
+	HEURISTIC_OCTILE,
+	HEURISTIC_MANHATTAN,
+	HEURISTIC_EUCLIDEAN,
+	HEURISTIC_ZERO,
+	// ALT, needs a LandmarkTable in the grid
+	HEURISTIC_LANDMARKS,
+	HEURISTIC_COUNT
+};
+
+enum CostType
+{
+	COST_INT,
+	COST_FLOAT
+};
+
+// Grid paths follow the 8 (or 4) directions, the Theta* modes link parents across any node in line of sight
+enum PathMode
+{
+	PATH_GRID,
+	PATH_THETA,
+	PATH_LAZY_THETA,
+	PATH_MODE_COUNT
+};
+
+// Traversal cost multipliers the editor can paint, any value from 1 to 255 is valid in the grid
+enum TerrainCost
+{
+	TERRAIN_ROAD = 1,
+	TERRAIN_GROUND = 2,
+	TERRAIN_MUD = 4,
+	TERRAIN_WATER = 8
+};
+
+// Runtime description of a query, FindPath picks the matching kernel instantiation
+struct SearchConfig
+{
+	Connectivity connectivity;
+	// Allows diagonal steps that squeeze past a wall corner
+	bool cutCorners;
+	PathMode mode;
+	// Compresses the retraced path down to its turning points
+	bool smoothPath;
+	HeuristicType heuristic;
+	CostType cost;
+	// Records the open and closed sets into the search trace, ignored when it is compiled out
+	bool recordTrace;
+	// Side of the square agent in nodes, anchored at its top left node. Above 1 the grid needs a clearance map
+	int agentSize;
+};
+
+// Settings the editor starts with and the server always uses
+SearchConfig MakeDefaultSearchConfig();
+
+template <typename CostT>
+struct OpenEntry
+{
+	CostT fCost;
+	CostT hCost;
+	int id;
+};
+
+// Step costs for each cost type, int keeps the classic 10/14 scaling
+template <typename CostT>
+struct CostTraits;
+
+template <>
+struct CostTraits<int>
+{
+	static int Straight() { return 10; }
+	static int Diagonal() { return 14; }
+	static int Infinity() { return std::numeric_limits<int>::max(); }
+};
+
+template <>
+struct CostTraits<float>
+{
+	static float Straight() { return 1.0f; }
+	static float Diagonal() { return 1.41421356f; }
+	static float Infinity() { return std::numeric_limits<float>::max(); }
+};
+
+// Heuristics take the absolute cell offsets to the target
+struct OctileHeuristic
+{
+	template <typename CostT>
+	static CostT Estimate(int dx, int dy)
+	{
+		int diagonal = std::min(dx, dy);
+		int straight = std::max(dx, dy) - diagonal;
+		return CostTraits<CostT>::Diagonal() * diagonal + CostTraits<CostT>::Straight() * straight;
+	}
+};
+
+// Only admissible with four-connected movement
+struct ManhattanHeuristic
+{
+	template <typename CostT>
+	static CostT Estimate(int dx, int dy)
+	{
+		return CostTraits<CostT>::Straight() * (dx + dy);
+	}
+};
+
+// Measured in diagonal steps so the rounded 10/14 costs never get overestimated
+struct EuclideanHeuristic
+{
+	template <typename CostT>
+	static CostT Estimate(int dx, int dy)
+	{
+		double length = std::sqrt(static_cast<double>(dx * dx + dy * dy));
+		return static_cast<CostT>(length * CostTraits<CostT>::Diagonal() / 1.4142135623730951);
+	}
+};
+
+// Turns A* into Dijkstra
+struct ZeroHeuristic
+{
+	template <typename CostT>
+	static CostT Estimate(int, int)
+	{
+		return CostT();
+	}
+};
+
+// Bounds the remaining cost with the triangle inequality over the landmarks of the grid, which
+// follows walls instead of ignoring them. Only a tag, PathSearch reads the table itself
+struct LandmarkHeuristic
+{
+};
+
+class LandmarkTable;
+class ContractionHierarchy;
+class PathDatabase;
+class SubgoalGraph;
+
+// Orders the open set heap so the lowest fCost (then lowest hCost) is on top
+template <typename CostT>
+struct OpenEntryGreater
+{
+	bool operator()(const OpenEntry<CostT>& a, const OpenEntry<CostT>& b) const
+	{
+		return a.fCost > b.fCost || (a.fCost == b.fCost && a.hCost > b.hCost);
+	}
+};
+
+// Per node A* state, kept between queries so a search does not allocate
+template <typename CostT>
+struct SearchSpace
+{
+	SearchSpace() : generation(0) {}
+
+	// Sizes the arrays for the grid, only reallocates when the grid grows
+	void Resize(int nodeCount)
+	{
+		gCost.resize(nodeCount);
+		parent.resize(nodeCount);
+		openedIn.resize(nodeCount, 0);
+		closedIn.resize(nodeCount, 0);
+	}
+
+	// Starts a new query, bumping the generation invalidates every node at once
+	void Reset()
+	{
+		openSet.clear();
+		generation++;
+		if (generation == 0)
+		{
+			std::fill(openedIn.begin(), openedIn.end(), 0);
+			std::fill(closedIn.begin(), closedIn.end(), 0);
+			generation = 1;
+		}
+	}
+
+	std::vector<CostT> gCost;
+	std::vector<int> parent;
+	// A node is open/closed when its stamp matches the current generation
+	std::vector<unsigned int> openedIn;
+	std::vector<unsigned int> closedIn;
+	unsigned int generation;
+	// Binary heap ordered by OpenEntryGreater, stale entries are skipped on pop
+	std::vector<OpenEntry<CostT> > openSet;
+};
+
+// Milliseconds since begin on the high resolution clock
+double GetElapsedMs(std::chrono::steady_clock::time_point begin);
+
+// Indexes a worker claims at a time from ParallelFor
+const int GLOBAL_CONST_PARALLEL_CHUNK = 64;
+
+// Runs body(index, worker) for every index below count on up to threadCount threads, the calling
+// thread being worker 0. Preprocessing uses it, body keeps its scratch per worker
+template <typename Function>
+void ParallelFor(int count, int threadCount, Function body)
+{
+	std::atomic<int> next(0);
+	auto work = [&](int worker) {
+		while (true)
+		{
+			const int begin = next.fetch_add(GLOBAL_CONST_PARALLEL_CHUNK);
+			if (begin >= count)
+			{
+				return;
+			}
+			for (int i = begin; i < std::min(count, begin + GLOBAL_CONST_PARALLEL_CHUNK); i++)
+			{
+				body(i, worker);
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int worker = 1; worker < threadCount && worker * GLOBAL_CONST_PARALLEL_CHUNK < count; worker++)
+	{
+		threads.push_back(std::thread(work, worker));
+	}
+	work(0);
+	for (std::thread& thread:threads)
+	{
+		thread.join();
+	}
+}
+
+// Counters and timings of one query
+struct SearchStats
+{
+	int nodesExpanded;
+	// Largest size the open set heap reached, stale entries included
+	int openPeak;
+	// Length of the final path in nodes, 0 when none was found
+	float pathLength;
+	double findPathMs;
+	double retraceMs;
+};
+
+// Order nodes entered the open and closed sets during a query, in a ring that keeps the
+// last GLOBAL_CONST_TRACE_CAPACITY events. An event is the node id shifted left once, low bit set when closed
+class SearchTrace
+{
+public:
+	SearchTrace();
+
+	void Clear() { mCount = 0; }
+	void Record(int node, bool closed)
+	{
+		mEvents[mCount & (GLOBAL_CONST_TRACE_CAPACITY - 1)] = static_cast<unsigned int>(node) << 1 | (closed ? 1u : 0u);
+		mCount++;
+	}
+	// Events still in the ring, oldest first
+	void CopyTo(std::vector<unsigned int>& events) const;
+
+private:
+	std::vector<unsigned int> mEvents;
+	// Events recorded since Clear, including the overwritten ones
+	size_t mCount;
+};
+
+// Grid a search runs on, borrowed from a snapshot or a mapped map file. Walkability is
+// packed a bit per node, bit id & 7 of byte id >> 3, the same layout as the map file section
+struct GridView
+{
+	int columns;
+	int rows;
+	const unsigned char* walkableBits;
+	// Null when every node costs TERRAIN_GROUND
+	const unsigned char* terrainCost;
+	int minTerrainCost;
+	// Byte per node from ComputeClearance, only needed for agents larger than a node
+	const unsigned char* clearance;
+	// Null unless a query uses HEURISTIC_LANDMARKS, built from this grid
+	const LandmarkTable* landmarks;
+	// Preprocessed hierarchy of this grid, null when there is none. Queries it matches skip A* entirely
+	const ContractionHierarchy* contraction;
+	// First move tables of this grid, null when there are none. Queries it matches are answered from them
+	const PathDatabase* pathDatabase;
+	// Subgoal graph of this grid, null when there is none. Queries it matches search it instead of the grid
+	const SubgoalGraph* subgoals;
+
+	// Helpers for the searches built outside PathSearch, which keeps its own specialized copies
+	int GetCellId(int x, int y) const { return x * rows + y; }
+	int GetTerrainCost(int id) const { return terrainCost != nullptr ? terrainCost[id] : static_cast<int>(TERRAIN_GROUND); }
+	bool IsWalkable(int x, int y) const
+	{
+		if (x < 0 || x >= columns || y < 0 || y >= rows)
+		{
+			return false;
+		}
+		const int id = GetCellId(x, y);
+		return (walkableBits[id >> 3] >> (id & 7)) & 1;
+	}
+	// Same rule as PathSearch, a diagonal may only squeeze past a wall corner when cutCorners is set
+	bool CanStep(int x, int y, int neighborX, int neighborY, bool cutCorners) const
+	{
+		if (!IsWalkable(neighborX, neighborY))
+		{
+			return false;
+		}
+		if (!cutCorners && x != neighborX && y != neighborY)
+		{
+			return IsWalkable(neighborX, y) && IsWalkable(x, neighborY);
+		}
+		return true;
+	}
+};
+
+// Packs a byte per node walkability into the GridView bit layout
+void PackWalkableBits(const std::vector<unsigned char>& walkable, std::vector<unsigned char>& bits);
+
+// Clearance of a node is the side of the largest walkable square with the node as its top left corner,
+// capped at GLOBAL_CONST_MAX_AGENT_SIZE. An agent of size k fits on every node with a clearance of k or more
+void ComputeClearance(const GridView& grid, std::vector<unsigned char>& clearance);
+// Brings the clearance up to date after the walkability of one node changed. Only the nodes
+// up to GLOBAL_CONST_MAX_AGENT_SIZE - 1 left of and above it can see it, so only those are recomputed
+void UpdateClearance(const GridView& grid, int x, int y, std::vector<unsigned char>& clearance);
+
+// Map file layout, little endian. The header is followed by the section table, every
+// section starts 8 byte aligned so a mapped file is used in place without parsing
+const char GLOBAL_CONST_MAP_MAGIC[4] = { 'P', 'F', 'M', 'P' };
+const uint32_t GLOBAL_CONST_MAP_VERSION = 1;
+
+enum MapSectionType
+{
+	// GridView walkability bits, required
+	MAP_SECTION_WALKABLE = 1,
+	// A cost byte per node, without it every node costs TERRAIN_GROUND
+	MAP_SECTION_TERRAIN = 2,
+	// Precomputed search indexes use types from here up, readers skip the ones they do not know
+	MAP_SECTION_FIRST_INDEX = 0x100,
+	// ContractionHierarchy::Serialize output
+	MAP_SECTION_CONTRACTION = MAP_SECTION_FIRST_INDEX,
+	// PathDatabase::Serialize output
+	MAP_SECTION_PATH_DATABASE = MAP_SECTION_FIRST_INDEX + 1
+};
+
+struct MapFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t columns;
+	uint32_t rows;
+	uint32_t minTerrainCost;
+	uint32_t sectionCount;
+};
+
+struct MapFileSection
+{
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+};
+
+// Contents of a section to write
+struct MapSectionData
+{
+	uint32_t type;
+	const void* data;
+	uint64_t size;
+};
+
+// Read only mapping of a map file, GetGrid and GetSection point straight into it
+class MapFile
+{
+public:
+	MapFile();
+	~MapFile();
+
+	// Maps and validates the header and section table, the sections themselves are not read
+	bool Open(const char* path);
+	void Close();
+	// Checks every walkable node costs at least minTerrainCost. Reads the whole terrain section, so Open
+	// leaves it to callers that can afford it, Write already refuses grids that fail it
+	bool Validate() const;
+	// Writes the grid along with any extra sections, usually precomputed indexes
+	static bool Write(const char* path, const GridView& grid, const std::vector<MapSectionData>& extraSections);
+
+	bool IsOpen() const { return mHeader != nullptr; }
+	GridView GetGrid() const;
+	// Start of the first section of that type, null when there is none
+	const unsigned char* GetSection(uint32_t type, uint64_t* size) const;
+
+private:
+	MapFile(const MapFile&) = delete;
+	MapFile& operator=(const MapFile&) = delete;
+
+	void* mData;
+	size_t mSize;
+	const MapFileHeader* mHeader;
+	const MapFileSection* mSections;
+};
+
+// A* engine working on a grid view, owned by the thread running the queries
+class PathSearch
+{
+public:
+	PathSearch();
+
+	// Picks the kernel instantiation matching the search settings. The grid is only
+	// borrowed for the query, it may point into a mapped map file
+	bool FindPath(const GridView& grid, int start, int target, const SearchConfig& config);
+	// Path of the last successful query from start to target, as node ids
+	const std::vector<int>& GetPath() const { return mPath; }
+	const SearchStats& GetStats() const { return mStats; }
+	const SearchTrace& GetTrace() const { return mTrace; }
+
+private:
+	// Times the private primitives one by one
+	friend class PathSearchBenchmark;
+
+	template <typename CostT>
+	bool DispatchConnectivity(int start, int target);
+	template <typename CostT, int Connectivity>
+	bool DispatchCorners(int start, int target);
+	template <typename CostT, int Connectivity, bool CutCorners>
+	bool DispatchMode(int start, int target);
+	template <typename CostT, int Connectivity, bool CutCorners, int Mode>
+	bool DispatchHeuristic(int start, int target);
+	template <int Connectivity, bool CutCorners, int Mode, typename HeuristicT, typename CostT>
+	bool FindPathKernel(int start, int target);
+	template <int Connectivity, bool CutCorners, typename CostT>
+	void SetVertex(SearchSpace<CostT>& space, int node);
+	template <typename CostT>
+	SearchSpace<CostT>& GetSearchSpace();
+	void RetracePath(const std::vector<int>& parent, int start, int target);
+	template <bool CutCorners>
+	void SmoothPath(std::vector<int>& path) const;
+	// Cost of one path segment the way the search charged it, in float units
+	template <bool CutCorners>
+	float GetRouteCost(int from, int to) const;
+	// Remaining cost from a node at the offsets to the target, scaled by the cheapest terrain
+	template <typename HeuristicT, typename CostT>
+	CostT Estimate(int node, int target, int dx, int dy) const;
+	bool IsCollinear(int a, int b, int c) const;
+	bool IsWalkable(int x, int y) const;
+	int GetTerrainCost(int id) const { return mTerrainCost != nullptr ? mTerrainCost[id] : static_cast<int>(TERRAIN_GROUND); }
+	template <bool CutCorners>
+	bool CanStep(int x, int y, int neighborX, int neighborY) const;
+	template <bool CutCorners>
+	int LineOfSight(int from, int to) const;
+	template <typename CostT>
+	CostT GetSegmentCost(int from, int to, int terrainCost) const;
+	int GetCellId(int x, int y) const { return x * mRows + y; }
+	float GetPathLength() const;
+
+	// Grid of the snapshot being searched, node ids run column by column
+	int mColumns;
+	int mRows;
+	const unsigned char* mWalkableBits;
+	const unsigned char* mTerrainCost;
+	int mMinTerrainCost;
+	const unsigned char* mClearance;
+	const LandmarkTable* mLandmarks;
+	SearchConfig mConfig;
+
+	SearchSpace<int> mIntSearch;
+	SearchSpace<float> mFloatSearch;
+	// Target side of contraction hierarchy queries, the start side uses mIntSearch
+	SearchSpace<int> mBackwardSearch;
+	std::vector<int> mPath;
+	SearchStats mStats;
+	SearchTrace mTrace;
+};
+
+// One query of a batch, the solver fills in everything after target
+struct PathQuery
+{
+	int start;
+	int target;
+	bool found;
+	float length;
+	std::vector<int> path;
+};
+
+// Solves batches of queries on a pool of threads, each with its own PathSearch
+class BatchSolver
+{
+public:
+	explicit BatchSolver(int threadCount);
+	~BatchSolver();
+
+	// Blocks until every query of the batch has its answer
+	void Solve(const GridView& grid, const SearchConfig& config, std::vector<PathQuery>& queries);
+
+private:
+	BatchSolver(const BatchSolver&) = delete;
+	BatchSolver& operator=(const BatchSolver&) = delete;
+
+	void WorkerLoop();
+
+	std::vector<std::thread> mWorkers;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+	// Batch being solved, guarded by mMutex like the counters
+	const GridView* mGrid;
+	const SearchConfig* mConfig;
+	std::vector<PathQuery>* mQueries;
+	// Next query to hand out and queries not answered yet
+	size_t mNext;
+	size_t mRemaining;
+	bool mStopping;
+};
+
+#endif
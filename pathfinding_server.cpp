@@ -0,0 +1,45 @@
+#include "contraction.h"
+#include "path_database.h"
+#include "query_server.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+
+// Usage: pathfinding_server map [socket] answers queries on the map without a window,
+// over the Unix domain socket when one is given and stdin/stdout otherwise. Queries go
+// through the path database or contraction hierarchy path_database_map or contract_map
+// added to the map, the database first when there are both
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s map [socket]\n", argv[0]);
+		return 1;
+	}
+
+	// A client closing before it read its answers must not kill the server, the write fails with EPIPE instead
+	signal(SIGPIPE, SIG_IGN);
+	MapFile file;
+	if (!file.Open(argv[1]))
+	{
+		return 1;
+	}
+	GridView grid = file.GetGrid();
+	ContractionHierarchy hierarchy;
+	uint64_t size = 0;
+	const unsigned char* section = file.GetSection(MAP_SECTION_CONTRACTION, &size);
+	if (section != nullptr && hierarchy.Attach(section, size))
+	{
+		grid.contraction = &hierarchy;
+	}
+	PathDatabase database;
+	section = file.GetSection(MAP_SECTION_PATH_DATABASE, &size);
+	if (section != nullptr && database.Attach(section, size))
+	{
+		grid.pathDatabase = &database;
+	}
+	QueryServer server(grid, static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+	bool served = argc >= 3 ? server.ServeSocket(argv[2]) : server.ServeStdio();
+	return served ? 0 : 1;
+}
@@ -0,0 +1,272 @@
+#include "pathfinding.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Usage: perfcheck --baseline file [--threshold percent] compares the scenario suite to a baseline
+// and exits with 1 when any metric got worse by more than the threshold,
+// perfcheck --write file records a new baseline
+const unsigned int GLOBAL_CONST_PERFCHECK_SEED = 7;
+// Queries per scenario. A round runs the whole list as many times as it takes to last the round time,
+// so every round measures the same mix and the p99 gets a few thousand samples. Queries per second
+// is the median round
+const int GLOBAL_CONST_PERFCHECK_QUERIES = 500;
+const double GLOBAL_CONST_PERFCHECK_ROUND_MS = 200.0;
+const int GLOBAL_CONST_PERFCHECK_ROUNDS = 5;
+const double GLOBAL_CONST_PERFCHECK_DEFAULT_THRESHOLD = 10.0;
+
+struct Scenario
+{
+	const char* name;
+	int columns;
+	int rows;
+	// Share of walls in percent
+	int walls;
+	// Paints random road, mud and water over the ground when set
+	bool mixedTerrain;
+	SearchConfig config;
+};
+
+struct ScenarioResult
+{
+	std::string name;
+	double queriesPerSecond;
+	double p99Ms;
+};
+
+// The standard suite, one scenario per search mode and cost type worth guarding
+std::vector<Scenario> MakeScenarios()
+{
+	SearchConfig grid = MakeDefaultSearchConfig();
+	SearchConfig gridFloat = grid;
+	gridFloat.cost = COST_FLOAT;
+	gridFloat.heuristic = HEURISTIC_EUCLIDEAN;
+	SearchConfig fourConnected = grid;
+	fourConnected.connectivity = FOUR_CONNECTED;
+	fourConnected.heuristic = HEURISTIC_MANHATTAN;
+	SearchConfig theta = grid;
+	theta.mode = PATH_THETA;
+	theta.heuristic = HEURISTIC_EUCLIDEAN;
+	SearchConfig lazyTheta = theta;
+	lazyTheta.mode = PATH_LAZY_THETA;
+
+	std::vector<Scenario> scenarios;
+	scenarios.push_back(Scenario{ "open_256_grid_int", 256, 256, 0, false, grid });
+	scenarios.push_back(Scenario{ "walls20_256_grid_int", 256, 256, 20, false, grid });
+	scenarios.push_back(Scenario{ "walls20_256_grid_float", 256, 256, 20, false, gridFloat });
+	scenarios.push_back(Scenario{ "walls20_256_four_connected", 256, 256, 20, false, fourConnected });
+	scenarios.push_back(Scenario{ "walls20_256_theta", 256, 256, 20, false, theta });
+	scenarios.push_back(Scenario{ "walls20_256_lazy_theta", 256, 256, 20, false, lazyTheta });
+	scenarios.push_back(Scenario{ "terrain_256_grid_int", 256, 256, 10, true, grid });
+	return scenarios;
+}
+
+ScenarioResult RunScenario(const Scenario& scenario, std::mt19937& random)
+{
+	const int nodeCount = scenario.columns * scenario.rows;
+	std::vector<unsigned char> walkable(nodeCount);
+	std::vector<unsigned char> terrainCost(nodeCount, TERRAIN_GROUND);
+	static const unsigned char terrains[4] = { TERRAIN_ROAD, TERRAIN_GROUND, TERRAIN_MUD, TERRAIN_WATER };
+	std::uniform_int_distribution<int> percent(0, 99);
+	for (int id = 0; id < nodeCount; id++)
+	{
+		walkable[id] = percent(random) >= scenario.walls;
+		if (scenario.mixedTerrain)
+		{
+			terrainCost[id] = terrains[percent(random) % 4];
+		}
+	}
+	std::vector<unsigned char> walkableBits;
+	PackWalkableBits(walkable, walkableBits);
+	GridView grid = { scenario.columns, scenario.rows, &walkableBits[0], &terrainCost[0], scenario.mixedTerrain ? TERRAIN_ROAD : TERRAIN_GROUND, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+	std::vector<int> openCells;
+	for (int id = 0; id < nodeCount; id++)
+	{
+		if (walkable[id])
+		{
+			openCells.push_back(id);
+		}
+	}
+	std::uniform_int_distribution<int> anyOpenCell(0, static_cast<int>(openCells.size()) - 1);
+	std::vector<int> queries(2 * GLOBAL_CONST_PERFCHECK_QUERIES);
+	for (int& node:queries)
+	{
+		node = openCells[anyOpenCell(random)];
+	}
+
+	PathSearch search;
+	std::vector<double> latencies;
+	std::vector<double> roundRates;
+	// The first round is untimed, it sizes the search arrays and warms the caches
+	for (int round = 0; round <= GLOBAL_CONST_PERFCHECK_ROUNDS; round++)
+	{
+		if (round == 1)
+		{
+			latencies.clear();
+		}
+		int roundQueries = 0;
+		std::chrono::steady_clock::time_point roundBegin = std::chrono::steady_clock::now();
+		double roundMs = 0.0;
+		while (roundMs < GLOBAL_CONST_PERFCHECK_ROUND_MS)
+		{
+			for (int i = 0; i < GLOBAL_CONST_PERFCHECK_QUERIES; i++)
+			{
+				std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+				search.FindPath(grid, queries[2 * i], queries[2 * i + 1], scenario.config);
+				latencies.push_back(GetElapsedMs(begin));
+			}
+			roundQueries += GLOBAL_CONST_PERFCHECK_QUERIES;
+			roundMs = GetElapsedMs(roundBegin);
+		}
+		if (round > 0)
+		{
+			roundRates.push_back(roundQueries * 1000.0 / roundMs);
+		}
+	}
+
+	ScenarioResult result;
+	result.name = scenario.name;
+	std::nth_element(roundRates.begin(), roundRates.begin() + roundRates.size() / 2, roundRates.end());
+	result.queriesPerSecond = roundRates[roundRates.size() / 2];
+	// Nearest rank p99 over every timed query
+	const size_t rank = static_cast<size_t>(std::ceil(0.99 * latencies.size())) - 1;
+	std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+	result.p99Ms = latencies[rank];
+	return result;
+}
+
+bool WriteResults(const char* path, const std::vector<ScenarioResult>& results)
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", path);
+		return false;
+	}
+	fprintf(file, "{\n\t\"seed\": %u,\n\t\"scenarios\": [\n", GLOBAL_CONST_PERFCHECK_SEED);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"queries_per_second\": %.1f, \"p99_ms\": %.4f }%s\n",
+			results[i].name.c_str(),
+			results[i].queriesPerSecond,
+			results[i].p99Ms,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+	return true;
+}
+
+// Reads back the one scenario per line layout WriteResults produces
+bool ReadResults(const char* path, std::vector<ScenarioResult>& results)
+{
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Failed to open baseline %s\n", path);
+		return false;
+	}
+	char line[512];
+	while (fgets(line, sizeof(line), file) != nullptr)
+	{
+		char name[128];
+		ScenarioResult result;
+		if (sscanf(line, " { \"name\": \"%127[^\"]\", \"queries_per_second\": %lf, \"p99_ms\": %lf", name, &result.queriesPerSecond, &result.p99Ms) == 3)
+		{
+			result.name = name;
+			results.push_back(result);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* baselinePath = nullptr;
+	const char* writePath = nullptr;
+	double threshold = GLOBAL_CONST_PERFCHECK_DEFAULT_THRESHOLD;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::strcmp(argv[i], "--baseline") == 0)
+		{
+			baselinePath = argv[i + 1];
+		}
+		else if (std::strcmp(argv[i], "--write") == 0)
+		{
+			writePath = argv[i + 1];
+		}
+		else if (std::strcmp(argv[i], "--threshold") == 0)
+		{
+			threshold = std::atof(argv[i + 1]);
+		}
+	}
+	if (baselinePath == nullptr && writePath == nullptr)
+	{
+		fprintf(stderr, "Usage: %s --baseline file [--threshold percent] | --write file\n", argv[0]);
+		return 2;
+	}
+
+	std::mt19937 random(GLOBAL_CONST_PERFCHECK_SEED);
+	std::vector<ScenarioResult> results;
+	for (const Scenario& scenario:MakeScenarios())
+	{
+		results.push_back(RunScenario(scenario, random));
+	}
+
+	if (writePath != nullptr)
+	{
+		return WriteResults(writePath, results) ? 0 : 1;
+	}
+
+	std::vector<ScenarioResult> baseline;
+	if (!ReadResults(baselinePath, baseline))
+	{
+		return 1;
+	}
+
+	// Scenarios missing from the baseline are reported but cannot fail the check
+	int regressions = 0;
+	printf("%-28s %14s %14s %10s %10s\n", "scenario", "queries/s", "baseline", "p99 ms", "baseline");
+	for (const ScenarioResult& result:results)
+	{
+		const ScenarioResult* reference = nullptr;
+		for (const ScenarioResult& candidate:baseline)
+		{
+			if (candidate.name == result.name)
+			{
+				reference = &candidate;
+			}
+		}
+		if (reference == nullptr)
+		{
+			printf("%-28s %14.1f %14s %10.4f %10s  new\n", result.name.c_str(), result.queriesPerSecond, "-", result.p99Ms, "-");
+			continue;
+		}
+
+		const bool slower = result.queriesPerSecond < reference->queriesPerSecond * (1.0 - threshold / 100.0);
+		const bool laggier = result.p99Ms > reference->p99Ms * (1.0 + threshold / 100.0);
+		printf("%-28s %14.1f %14.1f %10.4f %10.4f  %s\n",
+			result.name.c_str(),
+			result.queriesPerSecond,
+			reference->queriesPerSecond,
+			result.p99Ms,
+			reference->p99Ms,
+			slower || laggier ? "REGRESSED" : "ok");
+		regressions += slower || laggier;
+	}
+
+	if (regressions > 0)
+	{
+		printf("%d scenario(s) regressed by more than %.1f%%\n", regressions, threshold);
+		return 1;
+	}
+	printf("No regressions past %.1f%%\n", threshold);
+	return 0;
+}
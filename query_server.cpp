@@ -0,0 +1,275 @@
+#include "query_server.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Queries the server hands to the batch solver at once
+const size_t GLOBAL_CONST_SERVER_BATCH_SIZE = 256;
+// Unsent response bytes at which the server stops reading queries until the client catches up
+const size_t GLOBAL_CONST_SERVER_MAX_PENDING_OUTPUT = 1 << 20;
+// Longest query line accepted, the connection is dropped past it
+const size_t GLOBAL_CONST_SERVER_MAX_LINE = 256;
+
+QueryServer::QueryServer(const GridView& grid, int threadCount)
+	: mSolver(threadCount)
+{
+	mGrid = grid;
+	mConfig = MakeDefaultSearchConfig();
+}
+
+bool QueryServer::ServeStdio()
+{
+	return Serve(STDIN_FILENO, STDOUT_FILENO);
+}
+
+bool QueryServer::ServeSocket(const char* path)
+{
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (std::strlen(path) >= sizeof(address.sun_path))
+	{
+		PathfindingLog("Socket path %s is too long", path);
+		return false;
+	}
+	std::strcpy(address.sun_path, path);
+
+	// A socket file left behind by an earlier run would make bind fail. Anything else at the
+	// path is left alone and bind reports it
+	struct stat status;
+	if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode))
+	{
+		unlink(path);
+	}
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 8) != 0)
+	{
+		PathfindingLog("Failed to listen on %s: %s", path, strerror(errno));
+		if (listener >= 0)
+		{
+			close(listener);
+		}
+		return false;
+	}
+
+	PathfindingLog("Serving path queries on %s", path);
+	while (true)
+	{
+		int client = accept(listener, nullptr, nullptr);
+		if (client < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			PathfindingLog("Failed to accept a client: %s", strerror(errno));
+			close(listener);
+			return false;
+		}
+		Serve(client, client);
+		close(client);
+	}
+}
+
+// Reading stops while GLOBAL_CONST_SERVER_MAX_PENDING_OUTPUT bytes wait to be sent, so a client
+// that does not read its answers fills the socket buffer and blocks instead of growing the server
+bool QueryServer::Serve(int inDescriptor, int outDescriptor)
+{
+	// Both are read first, a socket is the same descriptor twice
+	const int inFlags = fcntl(inDescriptor, F_GETFL);
+	const int outFlags = fcntl(outDescriptor, F_GETFL);
+	fcntl(inDescriptor, F_SETFL, inFlags | O_NONBLOCK);
+	fcntl(outDescriptor, F_SETFL, outFlags | O_NONBLOCK);
+	const bool served = ServeNonBlocking(inDescriptor, outDescriptor);
+	fcntl(outDescriptor, F_SETFL, outFlags);
+	fcntl(inDescriptor, F_SETFL, inFlags);
+	return served;
+}
+
+bool QueryServer::ServeNonBlocking(int inDescriptor, int outDescriptor)
+{
+	std::string input;
+	std::string output;
+	size_t written = 0;
+	bool inputOpen = true;
+	char chunk[65536];
+
+	while (true)
+	{
+		const size_t pendingOutput = output.size() - written;
+		// Lines already read are solved before reading more, as long as the output has room
+		if (pendingOutput < GLOBAL_CONST_SERVER_MAX_PENDING_OUTPUT && input.find('\n') != std::string::npos)
+		{
+			SolvePendingLines(input, output);
+			continue;
+		}
+		if (!inputOpen && pendingOutput == 0)
+		{
+			return true;
+		}
+
+		pollfd descriptors[2];
+		int count = 0;
+		if (inputOpen && pendingOutput < GLOBAL_CONST_SERVER_MAX_PENDING_OUTPUT)
+		{
+			descriptors[count++] = pollfd{ inDescriptor, POLLIN, 0 };
+		}
+		if (pendingOutput > 0)
+		{
+			descriptors[count++] = pollfd{ outDescriptor, POLLOUT, 0 };
+		}
+		if (poll(descriptors, count, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			PathfindingLog("Failed to poll: %s", strerror(errno));
+			return false;
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			if (descriptors[i].events == POLLIN && descriptors[i].revents != 0)
+			{
+				ssize_t size = read(inDescriptor, chunk, sizeof(chunk));
+				if (size > 0)
+				{
+					input.append(chunk, size);
+				}
+				else if (size == 0 || (errno != EAGAIN && errno != EINTR))
+				{
+					// A last line without a newline still counts
+					inputOpen = false;
+					if (!input.empty() && input[input.size() - 1] != '\n')
+					{
+						input += '\n';
+					}
+				}
+				if (input.size() > GLOBAL_CONST_SERVER_MAX_LINE && input.find('\n') == std::string::npos)
+				{
+					PathfindingLog("Query line too long, dropping the client");
+					return false;
+				}
+			}
+			else if (descriptors[i].events == POLLOUT && descriptors[i].revents != 0)
+			{
+				ssize_t size = write(outDescriptor, output.data() + written, output.size() - written);
+				if (size < 0 && (errno == EPIPE || errno == ECONNRESET))
+				{
+					// The client closed without reading its answers, which ends the session like closing its input
+					PathfindingLog("Client went away before reading %zu bytes", output.size() - written);
+					return true;
+				}
+				if (size < 0 && errno != EAGAIN && errno != EINTR)
+				{
+					PathfindingLog("Failed to write answers: %s", strerror(errno));
+					return false;
+				}
+				written += std::max<ssize_t>(0, size);
+				if (written == output.size())
+				{
+					output.clear();
+					written = 0;
+				}
+			}
+		}
+	}
+}
+
+void QueryServer::SolvePendingLines(std::string& input, std::string& output)
+{
+	mBatch.clear();
+	mBatchIds.clear();
+	mBatchErrors.clear();
+
+	size_t lineStart = 0;
+	size_t lineEnd;
+	while (mBatch.size() < GLOBAL_CONST_SERVER_BATCH_SIZE && (lineEnd = input.find('\n', lineStart)) != std::string::npos)
+	{
+		std::string line = input.substr(lineStart, lineEnd - lineStart);
+		lineStart = lineEnd + 1;
+		if (line.find_first_not_of(" \t\r") == std::string::npos)
+		{
+			continue;
+		}
+
+		// Bad lines keep their place in the batch so answers stay in order
+		mBatch.push_back(PathQuery());
+		mBatchIds.push_back(std::string());
+		mBatchErrors.push_back(std::string());
+		ParseQuery(line, mBatch.back(), mBatchIds.back(), mBatchErrors.back());
+	}
+	input.erase(0, lineStart);
+
+	mSolver.Solve(mGrid, mConfig, mBatch);
+	for (size_t i = 0; i < mBatch.size(); i++)
+	{
+		if (!mBatchErrors[i].empty())
+		{
+			output += mBatchIds[i] + " error " + mBatchErrors[i] + "\n";
+		}
+		else
+		{
+			AppendResponse(mBatchIds[i], mBatch[i], output);
+		}
+	}
+}
+
+// Bad queries get endpoints of -1, which the solver answers without searching
+void QueryServer::ParseQuery(const std::string& line, PathQuery& query, std::string& id, std::string& error) const
+{
+	query.start = -1;
+	query.target = -1;
+	char token[64];
+	int startX, startY, targetX, targetY;
+	char extra;
+	int fields = sscanf(line.c_str(), "%63s %d %d %d %d %c", token, &startX, &startY, &targetX, &targetY, &extra);
+	id = fields >= 1 ? token : "?";
+	if (fields != 5)
+	{
+		error = "expected id startX startY targetX targetY";
+		return;
+	}
+
+	const int coordinates[4] = { startX, startY, targetX, targetY };
+	for (int i = 0; i < 4; i++)
+	{
+		const int limit = i % 2 == 0 ? mGrid.columns : mGrid.rows;
+		if (coordinates[i] < 0 || coordinates[i] >= limit)
+		{
+			error = "node outside the map";
+			return;
+		}
+	}
+	query.start = startX * mGrid.rows + startY;
+	query.target = targetX * mGrid.rows + targetY;
+}
+
+void QueryServer::AppendResponse(const std::string& id, const PathQuery& query, std::string& output) const
+{
+	if (!query.found)
+	{
+		output += id + " none\n";
+		return;
+	}
+
+	char number[32];
+	snprintf(number, sizeof(number), " ok %.3f %zu", query.length, query.path.size());
+	output += id;
+	output += number;
+	for (int node:query.path)
+	{
+		snprintf(number, sizeof(number), " %d %d", node / mGrid.rows, node % mGrid.rows);
+		output += number;
+	}
+	output += '\n';
+}
@@ -0,0 +1,43 @@
+// Line based path query service for other processes on the same machine
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include "pathfinding.h"
+
+#include <string>
+#include <vector>
+
+// Answers path queries on a map for other processes, over stdio or a Unix domain socket.
+// Queries are lines of "id startX startY targetX targetY", answered in order with
+// "id ok length count x y ..." or "id none", or "id error reason" for a bad line.
+// Clients may pipeline any number of queries, complete lines are solved in batches
+class QueryServer
+{
+public:
+	QueryServer(const GridView& grid, int threadCount);
+
+	bool ServeStdio();
+	// Serves one client at a time until the process is stopped
+	bool ServeSocket(const char* path);
+
+private:
+	// Runs until the input ends and every response is written. The descriptors are made non-blocking
+	// while it runs and get their flags back afterwards, stdio is shared with the parent shell
+	bool Serve(int inDescriptor, int outDescriptor);
+	bool ServeNonBlocking(int inDescriptor, int outDescriptor);
+	// Takes up to a batch of complete lines off the front of the input
+	void SolvePendingLines(std::string& input, std::string& output);
+	// Fills in the endpoints, error is left empty when the line is a valid query
+	void ParseQuery(const std::string& line, PathQuery& query, std::string& id, std::string& error) const;
+	void AppendResponse(const std::string& id, const PathQuery& query, std::string& output) const;
+
+	GridView mGrid;
+	SearchConfig mConfig;
+	BatchSolver mSolver;
+	// Reused between batches
+	std::vector<PathQuery> mBatch;
+	std::vector<std::string> mBatchIds;
+	std::vector<std::string> mBatchErrors;
+};
+
+#endif
@@ -0,0 +1,538 @@
+#include "subgoal_graph.h"
+
+#include <algorithm>
+#include <limits>
+
+static const int offsetX[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+static const int offsetY[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+// Clearances are stored in 16 bits
+const int GLOBAL_CONST_SUBGOAL_MAX_SIDE = 0xffff;
+
+SubgoalGraph::SubgoalGraph()
+{
+	mGrid = GridView();
+	mTerrainCost = TERRAIN_GROUND;
+	mStats = SubgoalStats();
+}
+
+void SubgoalGraph::Clear()
+{
+	mSubgoals.clear();
+	mSubgoalIndex.clear();
+	mClearance.clear();
+	mLocal.clear();
+	mFirstEdge.clear();
+	mEdges.clear();
+	mFirstDown.clear();
+	mDown.clear();
+	mWalkableBits.clear();
+	mGrid = GridView();
+	mStats = SubgoalStats();
+}
+
+bool SubgoalGraph::Build(const GridView& grid, SubgoalLevels levels)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	Clear();
+	if (grid.columns > GLOBAL_CONST_SUBGOAL_MAX_SIDE || grid.rows > GLOBAL_CONST_SUBGOAL_MAX_SIDE)
+	{
+		PathfindingLog("Subgoal graphs need maps of at most %d by %d nodes", GLOBAL_CONST_SUBGOAL_MAX_SIDE, GLOBAL_CONST_SUBGOAL_MAX_SIDE);
+		return false;
+	}
+	const int nodeCount = grid.columns * grid.rows;
+	mWalkableBits.assign(grid.walkableBits, grid.walkableBits + (nodeCount + 7) / 8);
+	mGrid = GridView();
+	mGrid.columns = grid.columns;
+	mGrid.rows = grid.rows;
+	mGrid.walkableBits = &mWalkableBits[0];
+	mGrid.minTerrainCost = grid.minTerrainCost;
+	mTerrainCost = -1;
+	for (int id = 0; id < nodeCount; id++)
+	{
+		if (!grid.IsWalkable(id / grid.rows, id % grid.rows))
+		{
+			continue;
+		}
+		if (mTerrainCost >= 0 && grid.GetTerrainCost(id) != mTerrainCost)
+		{
+			PathfindingLog("Subgoal graphs need every walkable node to have the same terrain cost");
+			Clear();
+			return false;
+		}
+		mTerrainCost = grid.GetTerrainCost(id);
+	}
+
+	// A wall diagonal to a node is a corner to walk around when both nodes beside it are open
+	mSubgoalIndex.assign(nodeCount, -1);
+	for (int id = 0; id < nodeCount; id++)
+	{
+		const int x = id / grid.rows;
+		const int y = id % grid.rows;
+		if (!grid.IsWalkable(x, y))
+		{
+			continue;
+		}
+		for (int i = 4; i < 8; i++)
+		{
+			const int cornerX = x + offsetX[i];
+			const int cornerY = y + offsetY[i];
+			if (cornerX >= 0 && cornerX < grid.columns && cornerY >= 0 && cornerY < grid.rows &&
+				!grid.IsWalkable(cornerX, cornerY) && grid.IsWalkable(cornerX, y) && grid.IsWalkable(x, cornerY))
+			{
+				mSubgoalIndex[id] = static_cast<int>(mSubgoals.size());
+				mSubgoals.push_back(id);
+				break;
+			}
+		}
+	}
+
+	// Each line is swept against its direction, a node's clearance is one more than the next node's
+	mClearance.assign(static_cast<size_t>(nodeCount) * 4, 0);
+	for (int direction = 0; direction < 4; direction++)
+	{
+		const int stepX = offsetX[direction];
+		const int stepY = offsetY[direction];
+		const int firstX = stepX > 0 ? grid.columns - 1 : 0;
+		const int firstY = stepY > 0 ? grid.rows - 1 : 0;
+		for (int x = firstX; x >= 0 && x < grid.columns; x += stepX != 0 ? -stepX : 1)
+		{
+			for (int y = firstY; y >= 0 && y < grid.rows; y += stepY != 0 ? -stepY : 1)
+			{
+				const int nextX = x + stepX;
+				const int nextY = y + stepY;
+				if (!grid.IsWalkable(nextX, nextY) || IsSubgoal(grid.GetCellId(nextX, nextY)))
+				{
+					continue;
+				}
+				mClearance[static_cast<size_t>(grid.GetCellId(x, y)) * 4 + direction] =
+					static_cast<uint16_t>(mClearance[static_cast<size_t>(grid.GetCellId(nextX, nextY)) * 4 + direction] + 1);
+			}
+		}
+	}
+
+	// Edges are kept both ways, the reverse of a walk is a walk too
+	const int subgoalCount = static_cast<int>(mSubgoals.size());
+	std::vector<std::vector<SubgoalEdge> > edges(subgoalCount);
+	for (int i = 0; i < subgoalCount; i++)
+	{
+		VisitDirectHReachable(mSubgoals[i], [&](int node, int cost) {
+			const int j = mSubgoalIndex[node];
+			for (int direction = 0; direction < 2; direction++)
+			{
+				std::vector<SubgoalEdge>& list = edges[direction == 0 ? i : j];
+				const int other = direction == 0 ? j : i;
+				bool known = false;
+				for (const SubgoalEdge& edge:list)
+				{
+					known = known || edge.node == other;
+				}
+				if (!known)
+				{
+					list.push_back(SubgoalEdge{ other, cost });
+				}
+			}
+		});
+	}
+	std::vector<std::vector<SubgoalEdge> > upward(subgoalCount);
+	if (levels == SUBGOAL_TWO_LEVEL)
+	{
+		MakeLocalSubgoals(edges, upward);
+	}
+
+	// Edges are stored with node ids from here on
+	mFirstEdge.assign(subgoalCount + 1, 0);
+	mFirstDown.assign(subgoalCount + 1, 0);
+	mLocal.assign(subgoalCount, 0);
+	std::vector<std::vector<SubgoalEdge> > downward(subgoalCount);
+	for (int i = 0; i < subgoalCount; i++)
+	{
+		mFirstEdge[i] = static_cast<int>(mEdges.size());
+		const std::vector<SubgoalEdge>& list = upward[i].empty() ? edges[i] : upward[i];
+		for (const SubgoalEdge& edge:list)
+		{
+			mEdges.push_back(SubgoalEdge{ mSubgoals[edge.node], edge.weight });
+		}
+		for (const SubgoalEdge& edge:upward[i])
+		{
+			downward[edge.node].push_back(SubgoalEdge{ mSubgoals[i], edge.weight });
+		}
+		mLocal[i] = upward[i].empty() ? 0 : 1;
+		mStats.globalSubgoals += upward[i].empty() ? 1 : 0;
+	}
+	mFirstEdge[subgoalCount] = static_cast<int>(mEdges.size());
+	for (int i = 0; i < subgoalCount; i++)
+	{
+		mFirstDown[i] = static_cast<int>(mDown.size());
+		mDown.insert(mDown.end(), downward[i].begin(), downward[i].end());
+	}
+	mFirstDown[subgoalCount] = static_cast<int>(mDown.size());
+
+	mStats.subgoals = subgoalCount;
+	mStats.edges = static_cast<int>(mEdges.size());
+	mStats.buildMs = GetElapsedMs(begin);
+	return true;
+}
+
+// Removing a subgoal has to keep the distance between every two of its neighbors. Each neighbor
+// runs a bounded Dijkstra over the global subgoals without it, a pair the search does not join
+// as cheaply needs a new edge, which is only possible when the pair walks at that cost
+void SubgoalGraph::MakeLocalSubgoals(std::vector<std::vector<SubgoalEdge> >& edges, std::vector<std::vector<SubgoalEdge> >& upward)
+{
+	const int subgoalCount = static_cast<int>(edges.size());
+	SearchSpace<int> witness;
+	witness.Resize(subgoalCount);
+	OpenEntryGreater<int> greater;
+	// Neighbor pairs that need an edge of their own once the subgoal is gone
+	std::vector<std::pair<int, int> > added;
+	std::vector<int> walk;
+	for (int subgoal = 0; subgoal < subgoalCount; subgoal++)
+	{
+		const std::vector<SubgoalEdge>& neighbors = edges[subgoal];
+		int maxWeight = 0;
+		for (const SubgoalEdge& edge:neighbors)
+		{
+			maxWeight = std::max(maxWeight, edge.weight);
+		}
+		added.clear();
+		bool bypassed = !neighbors.empty();
+		for (size_t a = 0; a < neighbors.size() && bypassed; a++)
+		{
+			const int source = neighbors[a].node;
+			const int limit = neighbors[a].weight + maxWeight;
+			witness.Reset();
+			witness.gCost[source] = 0;
+			witness.openedIn[source] = witness.generation;
+			witness.openSet.push_back(OpenEntry<int>{ 0, 0, source });
+			int settled = 0;
+			while (!witness.openSet.empty() && settled < GLOBAL_CONST_SUBGOAL_SETTLE_LIMIT)
+			{
+				std::pop_heap(witness.openSet.begin(), witness.openSet.end(), greater);
+				const OpenEntry<int> entry = witness.openSet.back();
+				witness.openSet.pop_back();
+				if (entry.fCost > limit)
+				{
+					break;
+				}
+				if (witness.closedIn[entry.id] == witness.generation)
+				{
+					continue;
+				}
+				witness.closedIn[entry.id] = witness.generation;
+				settled++;
+				for (const SubgoalEdge& edge:edges[entry.id])
+				{
+					const int cost = entry.fCost + edge.weight;
+					if (edge.node != subgoal && (witness.openedIn[edge.node] != witness.generation || cost < witness.gCost[edge.node]))
+					{
+						witness.openedIn[edge.node] = witness.generation;
+						witness.gCost[edge.node] = cost;
+						witness.openSet.push_back(OpenEntry<int>{ cost, cost, edge.node });
+						std::push_heap(witness.openSet.begin(), witness.openSet.end(), greater);
+					}
+				}
+			}
+
+			for (size_t b = a + 1; b < neighbors.size() && bypassed; b++)
+			{
+				const int target = neighbors[b].node;
+				const int weight = neighbors[a].weight + neighbors[b].weight;
+				if (witness.openedIn[target] == witness.generation && witness.gCost[target] <= weight)
+				{
+					continue;
+				}
+				walk.clear();
+				const int from = mSubgoals[source];
+				const int to = mSubgoals[target];
+				bypassed = GetOctileCost(from, to) == weight && (AppendWalk(from, to, true, walk) || AppendWalk(from, to, false, walk));
+				added.push_back(std::make_pair(source, target));
+			}
+		}
+		if (!bypassed)
+		{
+			continue;
+		}
+
+		upward[subgoal] = neighbors;
+		for (const SubgoalEdge& edge:neighbors)
+		{
+			std::vector<SubgoalEdge>& list = edges[edge.node];
+			list.erase(std::remove_if(list.begin(), list.end(), [&](const SubgoalEdge& other) { return other.node == subgoal; }), list.end());
+		}
+		for (const std::pair<int, int>& pair:added)
+		{
+			const int weight = GetOctileCost(mSubgoals[pair.first], mSubgoals[pair.second]);
+			for (int direction = 0; direction < 2; direction++)
+			{
+				std::vector<SubgoalEdge>& list = edges[direction == 0 ? pair.first : pair.second];
+				const int other = direction == 0 ? pair.second : pair.first;
+				bool known = false;
+				for (SubgoalEdge& edge:list)
+				{
+					if (edge.node == other)
+					{
+						edge.weight = std::min(edge.weight, weight);
+						known = true;
+					}
+				}
+				if (!known)
+				{
+					list.push_back(SubgoalEdge{ other, weight });
+				}
+			}
+		}
+		std::vector<SubgoalEdge>().swap(edges[subgoal]);
+	}
+}
+
+int SubgoalGraph::GetOctileCost(int from, int to) const
+{
+	const int dx = std::abs(from / mGrid.rows - to / mGrid.rows);
+	const int dy = std::abs(from % mGrid.rows - to % mGrid.rows);
+	const int diagonal = std::min(dx, dy);
+	return (diagonal * CostTraits<int>::Diagonal() + (std::max(dx, dy) - diagonal) * CostTraits<int>::Straight()) * mTerrainCost;
+}
+
+// The clearances bound the straight runs, a run out of a diagonal node only goes as far as the
+// run out of the diagonal node before it. Past that, the subgoal it ends at is reached more
+// directly through the one the earlier run found
+template <typename Function>
+void SubgoalGraph::VisitDirectHReachable(int node, Function visit) const
+{
+	const int rows = mGrid.rows;
+	for (int direction = 0; direction < 4; direction++)
+	{
+		const int steps = mClearance[static_cast<size_t>(node) * 4 + direction] + 1;
+		const int x = node / rows + offsetX[direction] * steps;
+		const int y = node % rows + offsetY[direction] * steps;
+		if (mGrid.IsWalkable(x, y) && IsSubgoal(mGrid.GetCellId(x, y)))
+		{
+			visit(mGrid.GetCellId(x, y), steps * CostTraits<int>::Straight() * mTerrainCost);
+		}
+	}
+
+	for (int diagonal = 4; diagonal < 8; diagonal++)
+	{
+		// The two straight directions the diagonal is made of
+		const int straight[2] = { offsetX[diagonal] > 0 ? 0 : 1, offsetY[diagonal] > 0 ? 2 : 3 };
+		int maxSteps[2] = { mClearance[static_cast<size_t>(node) * 4 + straight[0]], mClearance[static_cast<size_t>(node) * 4 + straight[1]] };
+		int x = node / rows;
+		int y = node % rows;
+		for (int i = 1; mGrid.CanStep(x, y, x + offsetX[diagonal], y + offsetY[diagonal], false); i++)
+		{
+			x += offsetX[diagonal];
+			y += offsetY[diagonal];
+			const int current = mGrid.GetCellId(x, y);
+			if (IsSubgoal(current))
+			{
+				visit(current, i * CostTraits<int>::Diagonal() * mTerrainCost);
+				break;
+			}
+			for (int side = 0; side < 2; side++)
+			{
+				const int direction = straight[side];
+				int steps = mClearance[static_cast<size_t>(current) * 4 + direction];
+				const int endX = x + offsetX[direction] * (steps + 1);
+				const int endY = y + offsetY[direction] * (steps + 1);
+				if (steps <= maxSteps[side] && mGrid.IsWalkable(endX, endY) && IsSubgoal(mGrid.GetCellId(endX, endY)))
+				{
+					visit(mGrid.GetCellId(endX, endY), (i * CostTraits<int>::Diagonal() + (steps + 1) * CostTraits<int>::Straight()) * mTerrainCost);
+					steps--;
+				}
+				maxSteps[side] = std::min(maxSteps[side], steps);
+			}
+		}
+	}
+}
+
+bool SubgoalGraph::AppendWalk(int from, int to, bool diagonalFirst, std::vector<int>& path) const
+{
+	const size_t length = path.size();
+	int x = from / mGrid.rows;
+	int y = from % mGrid.rows;
+	const int targetX = to / mGrid.rows;
+	const int targetY = to % mGrid.rows;
+	const int stepX = targetX > x ? 1 : (targetX < x ? -1 : 0);
+	const int stepY = targetY > y ? 1 : (targetY < y ? -1 : 0);
+	const int diagonalSteps = std::min(std::abs(targetX - x), std::abs(targetY - y));
+	const int straightSteps = std::max(std::abs(targetX - x), std::abs(targetY - y)) - diagonalSteps;
+	// The straight run follows the longer axis
+	const int straightX = std::abs(targetX - x) > std::abs(targetY - y) ? stepX : 0;
+	const int straightY = straightX == 0 ? stepY : 0;
+	for (int phase = 0; phase < 2; phase++)
+	{
+		const bool diagonal = (phase == 0) == diagonalFirst;
+		const int moveX = diagonal ? stepX : straightX;
+		const int moveY = diagonal ? stepY : straightY;
+		for (int i = diagonal ? diagonalSteps : straightSteps; i > 0; i--)
+		{
+			if (!mGrid.CanStep(x, y, x + moveX, y + moveY, false))
+			{
+				path.resize(length);
+				return false;
+			}
+			x += moveX;
+			y += moveY;
+			path.push_back(mGrid.GetCellId(x, y));
+		}
+	}
+	return true;
+}
+
+bool SubgoalGraph::Matches(const GridView& grid, const SearchConfig& config) const
+{
+	return !IsEmpty() &&
+		mGrid.columns == grid.columns &&
+		mGrid.rows == grid.rows &&
+		config.connectivity == EIGHT_CONNECTED &&
+		!config.cutCorners &&
+		config.mode == PATH_GRID &&
+		config.cost == COST_INT &&
+		config.agentSize == 1;
+}
+
+size_t SubgoalGraph::GetMemoryBytes() const
+{
+	return mWalkableBits.size() + mSubgoals.size() * sizeof(int) + mSubgoalIndex.size() * sizeof(int) + mClearance.size() * sizeof(uint16_t) +
+		(mFirstEdge.size() + mFirstDown.size()) * sizeof(int) + (mEdges.size() + mDown.size()) * sizeof(SubgoalEdge);
+}
+
+// targetSide marks the subgoals next to the target, open with their cost to it, and closes every
+// subgoal the upward edges lead to from them. Down edges are only taken into that closed set
+bool SubgoalGraph::FindPath(int start, int target, SearchSpace<int>& search, SearchSpace<int>& targetSide,
+	std::vector<int>& path, int& expanded) const
+{
+	path.clear();
+	expanded = 0;
+	path.push_back(start);
+	if (start == target)
+	{
+		return true;
+	}
+	// Nothing beats a walk as long as the octile distance
+	if (AppendWalk(start, target, true, path) || AppendWalk(start, target, false, path))
+	{
+		return true;
+	}
+	path.clear();
+
+	const int nodeCount = mGrid.columns * mGrid.rows;
+	search.Resize(nodeCount);
+	targetSide.Resize(nodeCount);
+	search.Reset();
+	targetSide.Reset();
+	VisitDirectHReachable(target, [&](int node, int cost) {
+		targetSide.openedIn[node] = targetSide.generation;
+		targetSide.gCost[node] = cost;
+		targetSide.openSet.push_back(OpenEntry<int>{ 0, 0, node });
+	});
+	while (!targetSide.openSet.empty())
+	{
+		const int node = targetSide.openSet.back().id;
+		targetSide.openSet.pop_back();
+		if (targetSide.closedIn[node] == targetSide.generation)
+		{
+			continue;
+		}
+		targetSide.closedIn[node] = targetSide.generation;
+		// Edges of a global subgoal stay in the global graph, which the search covers anyway
+		const int subgoal = mSubgoalIndex[node];
+		if (!mLocal[subgoal])
+		{
+			continue;
+		}
+		for (int i = mFirstEdge[subgoal]; i < mFirstEdge[subgoal + 1]; i++)
+		{
+			targetSide.openSet.push_back(OpenEntry<int>{ 0, 0, mEdges[i].node });
+		}
+	}
+
+	OpenEntryGreater<int> greater;
+	auto relax = [&](int from, int node, int cost) {
+		if (search.closedIn[node] == search.generation)
+		{
+			return;
+		}
+		if (search.openedIn[node] != search.generation || cost < search.gCost[node])
+		{
+			search.openedIn[node] = search.generation;
+			search.gCost[node] = cost;
+			search.parent[node] = from;
+			const int hCost = GetOctileCost(node, target);
+			search.openSet.push_back(OpenEntry<int>{ cost + hCost, hCost, node });
+			std::push_heap(search.openSet.begin(), search.openSet.end(), greater);
+		}
+	};
+	search.gCost[start] = 0;
+	search.parent[start] = start;
+	search.openedIn[start] = search.generation;
+	search.openSet.push_back(OpenEntry<int>{ 0, 0, start });
+	bool found = false;
+	while (!search.openSet.empty())
+	{
+		std::pop_heap(search.openSet.begin(), search.openSet.end(), greater);
+		const OpenEntry<int> entry = search.openSet.back();
+		search.openSet.pop_back();
+		const int node = entry.id;
+		if (search.closedIn[node] == search.generation)
+		{
+			continue;
+		}
+		search.closedIn[node] = search.generation;
+		expanded++;
+		if (node == target)
+		{
+			found = true;
+			break;
+		}
+		const int gCost = search.gCost[node];
+		if (node == start)
+		{
+			VisitDirectHReachable(start, [&](int next, int cost) { relax(node, next, gCost + cost); });
+		}
+		if (targetSide.openedIn[node] == targetSide.generation)
+		{
+			relax(node, target, gCost + targetSide.gCost[node]);
+		}
+		const int subgoal = mSubgoalIndex[node];
+		if (subgoal < 0)
+		{
+			continue;
+		}
+		for (int i = mFirstEdge[subgoal]; i < mFirstEdge[subgoal + 1]; i++)
+		{
+			relax(node, mEdges[i].node, gCost + mEdges[i].weight);
+		}
+		for (int i = mFirstDown[subgoal]; i < mFirstDown[subgoal + 1]; i++)
+		{
+			if (targetSide.closedIn[mDown[i].node] == targetSide.generation)
+			{
+				relax(node, mDown[i].node, gCost + mDown[i].weight);
+			}
+		}
+	}
+	if (!found)
+	{
+		return false;
+	}
+
+	// Subgoals back from the target, then each edge walked forwards. The path itself holds
+	// them first and drops them at the end, like the contraction hierarchy unpacking
+	for (int node = target; node != start; node = search.parent[node])
+	{
+		path.push_back(node);
+	}
+	path.push_back(start);
+	std::reverse(path.begin(), path.end());
+	const size_t subgoalPathCount = path.size();
+	path.push_back(start);
+	for (size_t i = 1; i < subgoalPathCount; i++)
+	{
+		if (!AppendWalk(path[i - 1], path[i], true, path) && !AppendWalk(path[i - 1], path[i], false, path))
+		{
+			path.clear();
+			return false;
+		}
+	}
+	path.erase(path.begin(), path.begin() + subgoalPathCount);
+	return true;
+}
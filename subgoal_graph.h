@@ -0,0 +1,105 @@
+// Subgoal graphs: A* over the convex wall corners of the map instead of over every node
+#ifndef SUBGOAL_GRAPH_H
+#define SUBGOAL_GRAPH_H
+
+#include "pathfinding.h"
+
+#include <vector>
+
+// Nodes the bypass search of a subgoal may settle while the two level graph is built. Past it the
+// subgoal stays global, which only leaves the graph a little larger
+const int GLOBAL_CONST_SUBGOAL_SETTLE_LIMIT = 64;
+
+enum SubgoalLevels
+{
+	// Every subgoal is searched
+	SUBGOAL_SIMPLE,
+	// Subgoals only needed to leave the start or reach the target are made local, the search
+	// only enters the local ones next to the start and the target
+	SUBGOAL_TWO_LEVEL
+};
+
+struct SubgoalEdge
+{
+	int node;
+	int weight;
+};
+
+// Counters of the last Build
+struct SubgoalStats
+{
+	int subgoals;
+	int globalSubgoals;
+	int edges;
+	double buildMs;
+};
+
+// A subgoal is a walkable node diagonal to a wall corner it can walk around, shortest paths only ever
+// turn at them. Two nodes are h-reachable when a path as short as their octile distance joins them, and
+// edges join the subgoals that are h-reachable with no other subgoal in between. A query joins the start
+// and the target to the subgoals they reach that way, runs A* over the edges and walks each edge as a
+// diagonal run and a straight run. The two level graph removes local subgoals the way a contraction
+// hierarchy does, adding an edge between two neighbors when no other path is as short, but only edges
+// that are h-reachable so every edge still walks. Defined for eight-connected moves without corner
+// cutting over a map of one terrain cost, with agents of one node
+class SubgoalGraph
+{
+public:
+	SubgoalGraph();
+
+	// Copies the walls it walks, so the grid may change or go away afterwards. Rebuild after editing
+	// walls or terrain. Fails on maps mixing terrain costs
+	bool Build(const GridView& grid, SubgoalLevels levels);
+	void Clear();
+
+	bool IsEmpty() const { return mSubgoalIndex.empty(); }
+	// True when the graph answers queries of that config on that grid exactly
+	bool Matches(const GridView& grid, const SearchConfig& config) const;
+	// Walls are left out of the graph, A* still answers queries starting or ending on one
+	bool Contains(int node) const { return mGrid.IsWalkable(node / mGrid.rows, node % mGrid.rows); }
+	// Fills path with every node from start to target, expanded counts the nodes the search expanded.
+	// The graph is only read, threads share it with search spaces of their own
+	bool FindPath(int start, int target, SearchSpace<int>& search, SearchSpace<int>& targetSide,
+		std::vector<int>& path, int& expanded) const;
+	const SubgoalStats& GetStats() const { return mStats; }
+	size_t GetMemoryBytes() const;
+
+private:
+	SubgoalGraph(const SubgoalGraph&) = delete;
+	SubgoalGraph& operator=(const SubgoalGraph&) = delete;
+
+	bool IsSubgoal(int node) const { return mSubgoalIndex[node] >= 0; }
+	// Calls visit(subgoal, cost) for every subgoal directly h-reachable from node, walking diagonals
+	// first and then straight lines out of each diagonal node
+	template <typename Function>
+	void VisitDirectHReachable(int node, Function visit) const;
+	// Appends the nodes after from up to to, the diagonal steps before or after the straight ones.
+	// False with path unchanged when that walk hits a wall
+	bool AppendWalk(int from, int to, bool diagonalFirst, std::vector<int>& path) const;
+	int GetOctileCost(int from, int to) const;
+	// Bypasses whose two ends the search cannot join within the settle limit become edges, or keep
+	// the subgoal global when they do not walk
+	void MakeLocalSubgoals(std::vector<std::vector<SubgoalEdge> >& edges, std::vector<std::vector<SubgoalEdge> >& upward);
+
+	// Dimensions of the grid built from, its walkable bits pointing at mWalkableBits and nothing else set
+	GridView mGrid;
+	std::vector<unsigned char> mWalkableBits;
+	// Terrain of every walkable node, edge weights are octile costs times it
+	int mTerrainCost;
+	std::vector<int> mSubgoals;
+	// Position in mSubgoals of every node, -1 unless it is a subgoal
+	std::vector<int> mSubgoalIndex;
+	// Straight steps from every node before a wall, the map edge or a subgoal, four per node in offset order
+	std::vector<uint16_t> mClearance;
+	// Set on the subgoals the two level graph made local
+	std::vector<unsigned char> mLocal;
+	// Per subgoal, edges to global subgoals for a global one and edges to subgoals made local later
+	// or kept global for a local one. Down edges are those reversed, the search takes them towards the target
+	std::vector<int> mFirstEdge;
+	std::vector<SubgoalEdge> mEdges;
+	std::vector<int> mFirstDown;
+	std::vector<SubgoalEdge> mDown;
+	SubgoalStats mStats;
+};
+
+#endif